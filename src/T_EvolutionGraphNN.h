@@ -18,6 +18,7 @@
 
 #include <iostream>
 #include <iomanip>
+#include <sstream>
 #include <vector>
 #include <unordered_map>
 #include <queue>
@@ -28,12 +29,238 @@
 #include <cstring>
 #include <fstream>
 #include <random>
+#include <algorithm>
+#include <memory>
+#include <barrier>
+#include <functional>
+#include <mutex>
+#include <atomic>
+#include <climits>
+#include <chrono>
+#include <future>
+#include <cstdio>
+
+//Model files are mapped by mmap on POSIX systems, and read into memory elsewhere
+#if defined(__unix__) || defined(__APPLE__)
+#define T_EVOLUTIONGRAPHNN_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+//SIMD kernels are picked at runtime on x86 with GCC/Clang
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define T_EVOLUTIONGRAPHNN_X86
+#include <immintrin.h>
+#endif
 
 using namespace std;
 
 #define DEBUG
 
 
+// Accuracy of tanh used by compiled graphs
+enum TanhMode {
+	TANH_EXACT,	//tanh() from <math.h>, same results as GraphNode::run()
+	TANH_FAST	//FastTanh, vectorized approximation
+};
+
+// FastTanh approximates tanh by a rational function of degree 13/6
+// (the same form as Eigen's ptanh), inputs are clamped to [-9, 9]
+// Max absolute error against tanh() is 4.2e-7 for float (checked on every float),
+// and 3.5e-8 for double, where the coefficients limit the accuracy
+// Blocks of float are processed with AVX-512, AVX2 or SSE picked by the CPU at runtime,
+// every version uses the same operations in the same order, so results do not depend on the CPU
+class FastTanh {
+protected:
+	//Coefficients of the odd numerator and the even denominator
+	static constexpr float clampValue = 9.0f;
+	static constexpr float alpha1 = 4.89352455891786e-03f;
+	static constexpr float alpha3 = 6.37261928875436e-04f;
+	static constexpr float alpha5 = 1.48572235717979e-05f;
+	static constexpr float alpha7 = 5.12229709037114e-08f;
+	static constexpr float alpha9 = -8.60467152213735e-11f;
+	static constexpr float alpha11 = 2.00018790482477e-13f;
+	static constexpr float alpha13 = -2.76076847742355e-16f;
+	static constexpr float beta0 = 4.89352518554385e-03f;
+	static constexpr float beta2 = 2.26843463243900e-03f;
+	static constexpr float beta4 = 1.18534705686654e-04f;
+	static constexpr float beta6 = 1.19825839466702e-06f;
+
+	//Kernels for blocks of float
+	static void applyScalar(float* values, int count);
+#ifdef T_EVOLUTIONGRAPHNN_X86
+	__attribute__((target("sse2"))) static void applySSE(float* values, int count);
+	__attribute__((target("avx2"))) static void applyAVX2(float* values, int count);
+	__attribute__((target("avx512f"))) static void applyAVX512(float* values, int count);
+#endif
+
+	//Pick the kernel supported by the CPU
+	static void (*selectKernel())(float*, int);
+
+public:
+
+	//Approximate tanh of a single value
+	template <class T>
+	static T apply(T x);
+
+	//Approximate tanh of count values in place
+	template <class T>
+	static void apply(T* values, int count);
+
+	//Approximate tanh of count float values in place with SIMD
+	static void apply(float* values, int count);
+
+	//Get name of the instruction set used for blocks of float
+	static const char* getInstructionSet();
+};
+
+// Ids of activation functions, used to give single nodes their own activation
+enum ActivationId {
+	ACTIVATION_DEFAULT,				//Activation policy of the network
+	ACTIVATION_TANH,				//tanh(x)
+	ACTIVATION_HARD_TANH,			//x clamped to [-1, 1]
+	ACTIVATION_RELU,				//max(x, 0)
+	ACTIVATION_STEP,				//Sign of x, for logic circuits
+	ACTIVATION_PIECEWISE_LINEAR,	//tanh interpolated linearly between a few knots
+	ACTIVATION_COUNT				//Number of ids
+};
+
+// Activation policies pick the activation function of EvolutionGNN at compile time,
+// e.g. EvolutionGNN<float, ReLUActivation>
+// apply(x) activates a single value, apply(values, count, mode) activates a block in place
+// ActivationPolicy provides the block version for policies without a special one
+template <class Policy>
+struct ActivationPolicy {
+	template <class T>
+	static void apply(T* values, int count, TanhMode) {
+		for (int i = 0; i < count; ++i)
+			values[i] = Policy::apply(values[i]);
+	}
+};
+
+//tanh, TanhMode selects between tanh() and FastTanh for blocks
+struct TanhActivation {
+	static constexpr ActivationId id = ACTIVATION_TANH;
+
+	//Types narrower than float such as _Float16 have no tanh() of their own
+	template <class T>
+	static T apply(T x) {
+		return T(tanh(typename conditional<(sizeof(T) < sizeof(float)), float, T>::type(x)));
+	}
+
+	template <class T>
+	static void apply(T* values, int count, TanhMode mode) {
+		if (mode == TANH_FAST)
+			FastTanh::apply(values, count);
+		else
+			for (int i = 0; i < count; ++i)
+				values[i] = apply(values[i]);
+	}
+};
+
+//Clamp to [-1, 1]
+struct HardTanhActivation :ActivationPolicy<HardTanhActivation> {
+	static constexpr ActivationId id = ACTIVATION_HARD_TANH;
+	using ActivationPolicy<HardTanhActivation>::apply;
+
+	template <class T>
+	static T apply(T x) {
+		return x < T(-1) ? T(-1) : (x > T(1) ? T(1) : x);
+	}
+};
+
+//max(x, 0)
+struct ReLUActivation :ActivationPolicy<ReLUActivation> {
+	static constexpr ActivationId id = ACTIVATION_RELU;
+	using ActivationPolicy<ReLUActivation>::apply;
+
+	template <class T>
+	static T apply(T x) {
+		return x > T(0) ? x : T(0);
+	}
+};
+
+//Sign of x, 1 for True and -1 for False like the logic gate examples
+struct StepActivation :ActivationPolicy<StepActivation> {
+	static constexpr ActivationId id = ACTIVATION_STEP;
+	using ActivationPolicy<StepActivation>::apply;
+
+	template <class T>
+	static T apply(T x) {
+		return T(x > T(0)) - T(x < T(0));
+	}
+};
+
+//tanh interpolated linearly between knots 0, 0.5, 1, 1.5, 2, 3, and 1 from 4 onwards
+struct PiecewiseLinearActivation :ActivationPolicy<PiecewiseLinearActivation> {
+	static constexpr ActivationId id = ACTIVATION_PIECEWISE_LINEAR;
+	using ActivationPolicy<PiecewiseLinearActivation>::apply;
+
+	template <class T>
+	static T apply(T x) {
+		static constexpr float knots[] = { 0.0f, 0.5f, 1.0f, 1.5f, 2.0f, 3.0f, 4.0f };
+		static constexpr float levels[] = { 0.0f, 0.46211716f, 0.76159416f, 0.90514825f, 0.96402758f, 0.99505475f, 1.0f };
+
+		T a = x < T(0) ? -x : x;
+		T y = T(1);
+		for (int i = 1; i < 7; ++i)
+			if (a < T(knots[i])) {
+				y = T(levels[i - 1]) + (a - T(knots[i - 1])) * T((levels[i] - levels[i - 1]) / (knots[i] - knots[i - 1]));
+				break;
+			}
+		return x < T(0) ? -y : y;
+	}
+};
+
+//Apply activation of given id on a single value, ACTIVATION_DEFAULT uses Activation
+template <class Activation, class T>
+T applyActivation(int id, T x);
+
+//Apply activation of given id on a block of values in place
+template <class Activation, class T>
+void applyActivation(int id, T* values, int count, TanhMode mode);
+
+// EvoRandom is a small and fast random number generator (xoshiro256**)
+// Every EvolutionGNN owns one, so genomes mutate concurrently without sharing
+// the lock of rand(), and the result only depends on the seed
+// jump() advances the stream by 2^128 numbers, so split() can hand out
+// non-overlapping streams, e.g. one per genome
+class EvoRandom {
+protected:
+	unsigned long long state[4];	//Generator state, never all zero
+
+public:
+
+	//Construct a stream from a seed
+	EvoRandom(unsigned long long seed = 0);
+
+	//Restart the stream from a seed
+	void seed(unsigned long long seed);
+
+	//Get next 64 random bits
+	unsigned long long next();
+
+	//Get a random integer in [0, n)
+	int nextInt(int n);
+
+	//Get a random double in [0, 1)
+	double nextDouble();
+
+	//Advance the stream by 2^128 numbers
+	void jump();
+
+	//Return a copy of this stream and jump this one past it
+	EvoRandom split();
+
+	//Get state, used when saving
+	void getState(unsigned long long state[4]);
+
+	//Set state, used when loading
+	void setState(const unsigned long long state[4]);
+};
+
 // Connection manages a connection
 // The connection is directed from inNode to outNode
 // Input node's id is stored as inNodeId
@@ -56,6 +283,11 @@ protected:
 	int inNodeId;	//Id of input node
 	int outNodeId;	//Id of output node
 
+	//Back-indices, so a Connection can be removed from every list in O(1)
+	int index;			//Position in EvolutionGNN::con
+	int inConIndex;		//Position in inCon of outNode
+	int outConIndex;	//Position in outCon of inNode
+
 public:
 
 	//Initializer with default constructor
@@ -78,8 +310,9 @@ public:
 	//Set useABuffer
 	void setBufferState(bool bufferState);
 
-	//Get value
-	T get();
+	//Get value, weight times the read side, multiplied in Acc
+	template <class Acc = T>
+	Acc get();
 
 	//Get ABuffer
 	T getABuffer();
@@ -87,6 +320,12 @@ public:
 	//Get BBuffer
 	T getBBuffer();
 
+	//Set ABuffer
+	void setABuffer(T val);
+
+	//Set BBuffer
+	void setBBuffer(T val);
+
 	//Get weight
 	T getWeight();
 
@@ -114,6 +353,24 @@ public:
 	//Check if this Connection is not connected with either inNode or outNode
 	bool disconnected();
 
+	//Get position in EvolutionGNN::con
+	int getIndex();
+
+	//Set position in EvolutionGNN::con
+	void setIndex(int index);
+
+	//Get position in inCon of outNode
+	int getInConIndex();
+
+	//Set position in inCon of outNode
+	void setInConIndex(int index);
+
+	//Get position in outCon of inNode
+	int getOutConIndex();
+
+	//Set position in outCon of inNode
+	void setOutConIndex(int index);
+
 	//Used when writing to file
 	void writeToFile(fstream& out);
 
@@ -133,16 +390,57 @@ ostream& operator<<(ostream& o, Connection<T>& con) {
 	return o;
 }
 
+//Handle of a Connection inside a ConnectionPool
+typedef unsigned int ConnectionHandle;
+
+// ConnectionPool stores all Connections of a network in a single array
+// A Connection is referred to by a 32-bit handle (its index in the array),
+// which stays valid until the Connection is released
+// Released slots are reused through a free list, and everything is freed at once
+// with the pool, so copying a network copies a few flat arrays
+template <class T>
+class ConnectionPool {
+protected:
+	vector<Connection<T>> slots;		//All Connections, including released ones
+	vector<ConnectionHandle> freeList;	//Handles of released slots
+
+public:
+
+	//Create a Connection and return its handle
+	ConnectionHandle create(int inNodeId, int outNodeId, T weight = T(1), T ABuffer = T(0), T BBuffer = T(0), bool useABuffer = false);
+
+	//Release a Connection, its handle may be returned by create() again
+	void release(ConnectionHandle handle);
+
+	//Get Connection by handle
+	Connection<T>& operator[](ConnectionHandle handle);
+
+	//Reserve room for count Connections
+	void reserve(int count);
+
+	//Create count default Connections at once, used by bulk loading
+	//Return the handle of the first, the others follow it
+	ConnectionHandle allocate(int count);
+
+	//Get number of live Connections
+	int size();
+
+	//Release all Connections
+	void clear();
+};
+
 // GraphNode represents a single neuron in the GNN
 // GraphNode manages two lists of Connections: inCon, outCon
+// Connections are kept as handles into the ConnectionPool of the network,
+// which is passed to every function that touches them
 // GraphNode also has a unique id
 template <class T>
 class GraphNode {
 protected:
 
 	int id;	//Unique Id
-	vector<shared_ptr<Connection<T>>> inCon;	//Incoming connections
-	vector<shared_ptr<Connection<T>>> outCon;	//Outgoing connections
+	vector<ConnectionHandle> inCon;		//Incoming connections
+	vector<ConnectionHandle> outCon;	//Outgoing connections
 
 public:
 
@@ -156,33 +454,37 @@ public:
 	//Get id
 	int getId();
 
-	//Add incoming Connection ptr
-	void addInCon(shared_ptr<Connection<T>> in);
+	//Add incoming Connection
+	void addInCon(ConnectionPool<T>& pool, ConnectionHandle in);
 
-	//Remove incoming Connection ptr
-	void removeInCon(shared_ptr<Connection<T>> in);
+	//Remove incoming Connection in O(1)
+	//The last incoming Connection is moved into its place
+	void removeInCon(ConnectionPool<T>& pool, ConnectionHandle in);
 
-	//Add out-going Connection ptr
-	void addOutCon(shared_ptr<Connection<T>> out);
+	//Add out-going Connection
+	void addOutCon(ConnectionPool<T>& pool, ConnectionHandle out);
 
-	//Remove out-going Connection ptr
-	void removeOutCon(shared_ptr<Connection<T>> out);
+	//Remove out-going Connection in O(1)
+	//The last out-going Connection is moved into its place
+	void removeOutCon(ConnectionPool<T>& pool, ConnectionHandle out);
 
 	//Flip all outgoing connection buffers
-	void flipBuffer();
+	void flipBuffer(ConnectionPool<T>& pool);
 
-	//Run the neuron once
-	void run();
+	//Run the neuron once, summing and activating in Acc before storing as T
+	//activation selects an ActivationId for this node, ACTIVATION_DEFAULT uses Activation
+	template <class Activation = TanhActivation, class Acc = T>
+	void run(ConnectionPool<T>& pool, int activation = ACTIVATION_DEFAULT);
 
 	//Remove disconnected connections
 	//Call this once in a while to clean up useless connections
-	void removeDisconnectedConnections();
+	void removeDisconnectedConnections(ConnectionPool<T>& pool);
 
 	//Get inCon vector
-	vector<shared_ptr<Connection<T>>>& getInCon();
+	vector<ConnectionHandle>& getInCon();
 
 	//Get outCon vector
-	vector<shared_ptr<Connection<T>>>& getOutCon();
+	vector<ConnectionHandle>& getOutCon();
 };
 
 //Input GraphNode is a special type of GraphNode
@@ -200,8 +502,11 @@ public:
 	//Assignment opeartion, Assign input value
 	T operator=(T val);
 
+	//Get current input value
+	T get();
+
 	//Run, assigning input to all outCon
-	void run();
+	void run(ConnectionPool<T>& pool);
 };
 
 //Output GraphNode is a special type of GraphNode
@@ -219,841 +524,6000 @@ public:
 	//Return current computed output
 	T get();
 
-	//Run, calculate activation(sum of input)
-	void run();
+	//Overwrite current output, used when syncing from CompiledGraph
+	void set(T val);
+
+	//Run, calculate activation(sum of input) in Acc
+	template <class Activation = TanhActivation, class Acc = T>
+	void run(ConnectionPool<T>& pool, int activation = ACTIVATION_DEFAULT);
 };
 
-// EvolutionGNN is the entire envolutional graph neural network
-// It manages a list of GraphNode using a hashtable hashing by it's id
-// It manages a list of connections used in the graph neural network
-// It also manages a list of GraphNodes that acted as input
-// It also manages a list of GraphNodes that acted as output
-template <class T>
-class EvolutionGNN {
+// WorkerPool keeps a fixed group of threads alive between time steps
+// Idle workers park on a barrier until a job is given, so running a job
+// costs two barrier crossings instead of creating and joining threads
+// A WorkerPool can be shared by several EvolutionGNN, jobs are run one at a time
+class WorkerPool {
 protected:
+	int workerCount;		//Number of workers, including the thread calling execute()
+	vector<thread> workers;	//Workers 1 .. workerCount - 1, worker 0 is the caller
+	unique_ptr<barrier<>> sync;	//Barrier shared by all workers
 
-	//All input nodes, fixed, and will not be changed
-	vector<InputGraphNode<T>> inputNodes;
+	const function<void(int, int)>* job;	//Job currently running
+	bool stopping;	//Set when the pool is destroyed
+	mutex executing;	//Only one job may run at a time
 
-	//All output nodes, fixed, and will not be changed
-	vector<OutputGraphNode<T>> outputNodes;
+	//Remaining task range [begin, end) of each worker used by parallelFor()
+	//begin is kept in the high 32 bits and end in the low 32 bits, so a range
+	//can be shrunk from either side by a single compare-and-swap
+	unique_ptr<atomic<unsigned long long>[]> ranges;
 
-	//All available nodes inside the graph excluding inputNodes and outputNodes
-	//Index of hidden nodes will starts from |inputNodes.size() + outputNodes.size()|
-	unordered_map<int, GraphNode<T>> graphNodes;
-	vector<shared_ptr<Connection<T>>> con;
+	//Take the first task of a worker's range
+	bool popTask(int id, int& index);
 
-	//Total number of nodes
-	int nodeCount;
+	//Move the second half of victim's range to thief
+	bool stealTasks(int victim, int thief);
 
-	//Number of thread used to run
-	int threadCount;
+	//Main loop of workers
+	void work(int id);
 
 public:
 
-	//Construct empty EvolutionGNN
-	EvolutionGNN(int threadCount = -1);
+	//Create a pool with given number of workers
+	//The calling thread acts as one of the workers, so workerCount - 1 threads are created
+	WorkerPool(int workerCount);
 
-	//Constructor with known input and output size
-	EvolutionGNN(int inputCount, int outputCount, int threadCount = -1);
+	//Stop and join all workers
+	~WorkerPool();
 
-	//Constructor by inheritance from parents
-	EvolutionGNN(EvolutionGNN<T>& parentA, EvolutionGNN<T>& parentB, double AConRate = 0.7, double BConRate = 0.3, bool inheritMemory = false);
+	//Get number of workers
+	int getWorkerCount();
 
-	//Just like Constructor, initialize with known input and output size
-	void initialize(int inputCount, int outputCount, int threadCount = -1);
+	//Run job(workerId, workerCount) on every worker and wait for all to finish
+	void execute(const function<void(int, int)>& job);
 
-	//Get the number of input
-	int getInputSize();
+	//Wait until every worker reaches this point
+	//Should only be called inside a job, and by all workers the same number of times
+	void wait();
 
-	//Get the number of hidden nodes
-	int getHiddenSize();
+	//Run task(index, workerId) for every index in [0, count) and wait for all to finish
+	//Every worker starts with an equal slice, and steals half of the remaining slice
+	//of another worker when its own runs out, so uneven tasks still keep all workers busy
+	//Should not be called inside a job
+	void parallelFor(int count, const function<void(int, int)>& task);
+};
 
-	//Get the number of output
-	int getOutputSize();
+//Phases of a time step timed by PerfCounters
+enum PerfPhase {
+	PHASE_DISPATCH,	//From handing a job to the WorkerPool until every worker runs it
+	PHASE_RUN,		//Nodes read in-coming connections and write out-going ones, run()
+	PHASE_FLIP,		//Buffers flip, flipBuffer() or writeConnections() of the compiled graph
+	PHASE_JOIN,		//From the last worker finishing a job until the caller continues
+	PHASE_COUNT
+};
 
-	//Get the number of connections
-	int getConnectionSize();
+// PerfCounters accumulates where the time of run(), flipBuffer() and runSteps() goes
+// Counters are only filled if T_EVOLUTIONGRAPHNN_PERF_COUNTERS is defined before this
+// header is included; otherwise every hook is empty and every counter stays 0
+// Phases of a multi-threaded job add up to its wall time: dispatch until the last worker
+// starts, run and flip phases as seen by worker 0, and join after the last worker leaves
+class PerfCounters {
+protected:
+	long long steps;				//Number of steps, each run() is one step
+	long long edges;				//Connections processed by all steps, once per sample
+	double phaseTime[PHASE_COUNT];	//Wall time of each phase in seconds
+	vector<double> busyTime;		//Seconds each worker spent on nodes and connections
+	vector<double> idleTime;		//Seconds each worker spent waiting in run and flip phases
+	long long balancedPhases;		//Number of multi-threaded phases
+	double imbalanceSum;			//Sum of imbalance over multi-threaded phases
+	double imbalanceMax;			//Largest imbalance of a phase
+
+	//State of the job being timed, written by one worker each or by worker 0
+	vector<double> phaseBusy[2];	//Busy time of each worker in the current phase of a slot
+	vector<double> entered, left;	//When each worker entered and left the job
+	double jobStart;				//When the job was handed to the WorkerPool
+	double mark;					//End of the last closed phase, negative before the first
+
+	//Seconds on a steady clock
+	static double now();
+
+	//Add a phase ending at end, and the busy time of the first active workers in slot
+	void closePhase(PerfPhase phase, int slot, int active, double end);
 
-	//Clean up everything
-	void cleanUp();
+public:
 
-	//Set input to each inputNode
-	void setInput(int index, T val);
+	//Construct with every counter at 0
+	PerfCounters();
 
-	//Flip buffer for next run
-	void flipBuffer();
+	//Set every counter to 0
+	void reset();
 
-	//Flip buffer in a multi-threaded way, should be called by flipBuffer()
-	void thread_flipBuffer(int startId, int endId, int dummy = 0);
+	//Get number of steps timed
+	long long getSteps();
 
-	//Run the whole neural network
-	void run();
+	//Get number of connections processed
+	long long getEdges();
 
-	//Run in a multi-threaded way, should be called by run()
-	void thread_run(int startId, int endId, int dummy = 0);
+	//Get wall time of a phase in seconds
+	double getPhaseTime(PerfPhase phase);
 
-	//Determine number of thread to run
-	int determineNumberOfThread();
+	//Get number of workers seen so far
+	int getWorkerCount();
 
-	//Task arranger function, set protion of tasks to threads
-	double taskArranger(double x);
+	//Get seconds a worker spent on nodes and connections
+	double getBusyTime(int worker);
 
-	//Get output from each outputNode
-	T getOutput(int index);
+	//Get seconds a worker spent waiting for others in run and flip phases
+	double getIdleTime(int worker);
 
-	//Add hidden neuron
-	void addNodes(int count = 1);
+	//Get load imbalance of multi-threaded phases, busy time of the slowest worker divided
+	//by the mean busy time of active workers; 1 is perfectly balanced, 0 if none was timed
+	double getImbalance();
 
-	//Add connection between nodes
-	// node1 -------> node2
-	void addConnection(int node1, int node2, T weight = T(1), T ABuffer = T(0), T BBuffer = T(0), bool useABuffer = false);
+	//Get the largest imbalance of a single phase
+	double getMaxImbalance();
 
-	//Add connection between nodes with random input
-	// node1 -------> node2 (node1 should not be input nodes)
-	// weight following normal distribution
-	void addRandomConnection(int count = 1, unsigned int randomState = rand());
+	//Human readable summary of all counters
+	string summary();
 
-	//Remove a connection given by the index
-	void removeConnection(int index);
+	//Hooks called by EvolutionGNN
 
-	//Remove useless connections that are not connected to any nodes
-	void removeDisconnectedConnections();
+	//Count steps, each processing edges connections
+	void addSteps(long long count, long long edges);
 
-	//Save to file
-	void save(string filename = "./out.TEvoGNN");
+	//Time work() running on the calling thread alone as a phase
+	template <class Work>
+	void timeSerial(PerfPhase phase, const Work& work);
 
-	//Load from file
-	bool load(string path = "./out.TEvoGNN");
+	//Start timing a job run by workers workers, called before WorkerPool::execute()
+	void beginJob(int workers);
 
-	//Cross bread
-	//Accept two parents and selectively inherit their structures
-	//inputNodes = max(parentA.inputNodes.size(), parentB.inputNodes.size())
-	//outputNodes = max(parentA.inputNodes.size(), parentB.inputNodes.size())
-	//graphNodes = max(parentA.graphNodes.size(), parentB.graphNodes.size())
-	//AConRate: Percentage of connections been selected from parentA
-	//BConRate: Percentage of connections been selected from parentB
-	//inheritMemory: Select weither value and buffer states will be passed
-	void inherit(EvolutionGNN<T>& parentA, EvolutionGNN<T>& parentB, double AConRate = 0.7, double BConRate = 0.3, bool inheritMemory = false);
+	//Called by each worker when it enters and leaves the job
+	void enterJob(int id);
+	void leaveJob(int id);
 
-	//Mutate itself by deleting connections/creating new connections/creating new nodes
-	// newConRate to create new connection
-	// deleteConRate to delete connection
-	// newNodeRate to create new node
-	// repeatRate to mutate again (follows Geometric distributions)
-	void mutate(double newConRate = 0.5, double deleteConRate = 0.5, double newNodeRate = 0.0001, double repeatRate = 0.5);
+	//Call work() and add its duration to the busy time of worker id in slot
+	//Consecutive phases of a job use slots 0 and 1 in turn
+	template <class Work>
+	void timeWork(int id, int slot, const Work& work);
 
-	//Get the DOT representation for Graphviz
-	string getDOT();
+	//Close the phase of slot, called by worker 0 once every worker passed it
+	void endPhase(PerfPhase phase, int slot, int active);
 
-	//Save the DOT representation for Graphviz
-	void saveDOT(string filename = "model.dot");
+	//Close the last phase of slot unless phase is PHASE_COUNT, and add dispatch and join
+	//Called after WorkerPool::execute()
+	void endJob(PerfPhase phase = PHASE_COUNT, int slot = 0, int active = 0);
+};
 
-	//Testing function
-	void test(bool mt = false) {
-		srand(42);
-		cleanUp();
-		if (mt)initialize(1, 1);
-		else
-			initialize(1, 1, 1);
+//Order of hidden nodes inside a CompiledGraph
+enum NodeOrder {
+	ORDER_ID,		//Same order as node ids
+	ORDER_BFS,		//Breadth first from input and output nodes, so neighbours are stored close together
+	ORDER_RCM,		//Reverse Cuthill-McKee, keeps both ends of every connection within a narrow band
+	ORDER_DEGREE	//Most connected nodes first, so hubs share cache lines
+};
 
-		////Add extra 5 nodes
-		//for (int i = 0; i < 5; ++i)
-		//	addNodes();
-		////Add connections
-		//addConnection(0, 2, 30.0);
-		//addConnection(2, 3, 30.0);
-		//addConnection(3, 4, 30.0);
-		//addConnection(4, 5, 30.0);
-		//addConnection(5, 6, 30.0);
-		//addConnection(6, 1, 1.0);
-		////Loop back
-		//addConnection(6, 2, 30.0);
+//Find strongly connected components of a graph of count vertices, where the
+//successors of vertex v are targets[offsets[v] .. offsets[v + 1])
+//component gets the component of each vertex, numbered in topological order of the
+//condensation, so every edge between two components goes to the larger number
+//Return the number of components
+inline int findComponents(int count, const vector<int>& offsets, const vector<int>& targets, vector<int>& component);
+
+//Magic bytes at the start of model files of version 2 and later
+//Files of version 1 start with "InputNodes=" instead
+const char MODEL_MAGIC[8] = { 'T', 'E', 'v', 'o', 'G', 'N', 'N', '\0' };
+
+//Version of model files written by EvolutionGNN::save()
+const unsigned int MODEL_VERSION = 3;
+
+//Written in the byte order of the saving machine, files of another byte order are rejected
+const unsigned int MODEL_BYTE_ORDER = 0x01020304;
+
+//Every section of a model file starts at a multiple of this
+const unsigned int MODEL_ALIGNMENT = 64;
+
+//Bytes of connections read at once from a model file of version 1
+const int LOAD_CHUNK_BYTES = 1 << 24;
+
+//Number of connections decoded by one task when loading in parallel
+const int LOAD_BLOCK = 1 << 14;
+
+//Floating point types recorded in model files of version 3, so types of the same size
+//such as _Float16 and bfloat16 are told apart
+enum NumberType {
+	NUMBER_UNKNOWN,		//Any other type, only its size is checked
+	NUMBER_FLOAT16,		//_Float16
+	NUMBER_BFLOAT16,	//__bf16
+	NUMBER_FLOAT,
+	NUMBER_DOUBLE,
+	NUMBER_LONG_DOUBLE
+};
 
+//Get NumberType of X
+template <class X>
+unsigned int getNumberType();
+
+//Sections of a model file, each is a flat array in the layout of CompiledGraph
+//Positions are node ids after placing by NodeOrder, slots include free ones
+enum ModelSection {
+	SECTION_ROW_OFFSETS,	//int, first slot of each position, nodeCount + 1
+	SECTION_ROW_ENDS,		//int, end of live slots of each position, nodeCount
+	SECTION_SOURCES,		//int, position of inNode of each slot, -1 for free slots
+	SECTION_WEIGHTS,		//T, weight of each slot
+	SECTION_READ,			//T, buffer read by the next run of each slot
+	SECTION_WRITE,			//T, buffer written by the next run of each slot
+	SECTION_STATES,			//char, useABuffer of each slot
+	SECTION_INDICES,		//int, index of each slot in EvolutionGNN::con, -1 for free slots
+	SECTION_ORDER,			//int, node id at each position, nodeCount
+	SECTION_VALUES,			//Acc, value of each position, nodeCount, T in version 2
+	SECTION_ACTIVATIONS,	//unsigned char, ActivationId of each node id, nodeCount
+	SECTION_COUNT
+};
 
-		//Random initializations
-		for (int i = 0; i < 1000; ++i)
-			addNodes();
-		for (int i = 0; i < 10000; ++i)
-			addConnection(rand() % nodeCount, rand() % nodeCount, rand() % 2001 / 1000.0 - 1.0);
+// ModelHeader starts a model file of version 2 and later
+// Counts and section offsets are fixed-size fields, so a reader finds every
+// section without parsing, and a mapped file can be executed in place
+// Version 3 appends the accumulator and both NumberTypes, which fit in the padding
+// before the first section of version 2, so both versions share the layout
+struct ModelHeader {
+	char magic[8];				//MODEL_MAGIC
+	unsigned int version;		//MODEL_VERSION
+	unsigned int byteOrder;		//MODEL_BYTE_ORDER
+	unsigned int valueSize;		//sizeof(T)
+	unsigned int alignment;		//MODEL_ALIGNMENT
+	long long inputCount;		//Number of input nodes
+	long long outputCount;		//Number of output nodes
+	long long hiddenCount;		//Number of hidden node ids, including removed ones
+	long long connectionCount;	//Number of live connections
+	long long slotCount;		//Number of connection slots, including free ones
+	long long offsets[SECTION_COUNT];	//Offset of each section from the start of the file
+	long long fileSize;			//Size of the whole file
+	unsigned int accumulatorSize;	//sizeof(Acc), since version 3
+	unsigned int valueType;			//NumberType of T, since version 3
+	unsigned int accumulatorType;	//NumberType of Acc, since version 3
+	unsigned int reserved;			//0
+
+	//Fill magic, version, byte order and types for values of T accumulated in Acc
+	template <class T, class Acc>
+	void initialize(unsigned int version = MODEL_VERSION);
+
+	//Get the number of nodes
+	long long getNodeSize();
+
+	//Get size of a section in bytes
+	long long getSectionSize(int section);
+
+	//Place sections one after another at aligned offsets, and set fileSize
+	void layout();
+
+	//Check the header, and that the sections in data form a valid graph
+	//data is the whole file of given size, T and Acc are the types of the reader
+	//Values stored in Acc of another precision are only accepted if that is T
+	template <class T, class Acc>
+	bool check(const char* data, size_t size);
+
+	//Get values of all nodes from data converted to Acc, after check()
+	template <class T, class Acc>
+	vector<Acc> getValues(const char* data);
+};
 
+// MappedFile holds a whole file in memory, mapped by mmap where available
+// The mapping is private, so written pages are copied on first write and
+// the file itself is never changed
+// Without mmap the file is read into an aligned buffer instead
+class MappedFile {
+protected:
+	char* data;		//Start of the file
+	size_t size;	//Size of the file
+	bool mapped;	//Whether data is mapped by mmap, otherwise it is in storage
 
-		//OR gate
-		//for (int i = 0; i < 4; ++i)
-		//	addNodes();
-		////Add connections
-		//addConnection(0, 2);
-		//addConnection(0, 3);
-		//addConnection(2, 4, 40.0);
-		//addConnection(3, 4, 40.0);
-		//addConnection(5, 5, 40.0, 1.0, 1.0);	//Bias connection, constantly 1.0
-		//addConnection(5, 4, -20.0);				//Bias connection
-		//addConnection(4, 1, 40.0);
+	//Buffer of the file when it is not mapped
+	unique_ptr<char[]> storage;
 
-		////AND gate
-		//for (int i = 0; i < 6; ++i)
-		//	addNodes();
-		////Add connections
-		//addConnection(0, 2);
-		//addConnection(0, 3);
-		//addConnection(2, 4, -30.0);
-		//addConnection(3, 5, -30.0);
-		//addConnection(4, 6, 30.0);
-		//addConnection(5, 6, 30.0);
-		//addConnection(6, 7, -30.0);
-		//addConnection(7, 1, 1.0);
+public:
 
-		removeDisconnectedConnections();
+	//Construct empty MappedFile
+	MappedFile();
 
-		//Set initial input
-		setInput(0, 1);
-		run();
-		flipBuffer();
+	//Unmap the file
+	~MappedFile();
 
-		for (int i = 0; i < 100; ++i) {
-			//setInput(0, 0);
-			run();
-			flipBuffer();
-			printf("%7.3f", getOutput(0));
-			if (i % 15 == 0) cout << endl;
-		}
-		cout << endl << endl;
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
 
-		cout << "Writing to file..." << endl;
-		if (!mt) {
-			save("./single_thread.TEvoGNN");
-			load("./single_thread.TEvoGNN");
-		}
-		else {
-			save("./multi_thread.TEvoGNN");
-			load("./multi_thread.TEvoGNN");
-		}
-		cout << "Done!" << endl;
+	//Map a file, return false if it can not be read
+	bool open(const string& path);
 
-		cout << "Continue simulation after reloading from file" << endl; srand(42);
-		removeDisconnectedConnections();
+	//Unmap the file
+	void close();
 
-		for (int i = 0; i < 100; ++i) {
-			setInput(0, 0);
-			run();
-			flipBuffer();
-			printf("%7.3f", getOutput(0));
-			if (i % 15 == 0) cout << endl;
-		}
-		cout << endl << endl << endl;;
+	//Get the start of the file
+	char* getData();
+
+	//Get the size of the file
+	size_t getSize();
+
+	//Check if the file is mapped by mmap
+	bool isMapped();
+};
+
+// CompiledArray is a flat array of a CompiledGraph
+// It either owns its elements, or views a section of a MappedFile,
+// so a mapped model is executed in place without copying
+// Copying a viewing array copies its elements into an owned array
+template <class X>
+class CompiledArray {
+protected:
+	vector<X> owned;	//Elements of an owned array
+	X* elements;		//First element, in owned or in a mapping
+	size_t count;		//Number of elements
+
+public:
+
+	//Construct empty owned array
+	CompiledArray();
+
+	CompiledArray(const CompiledArray<X>& other);
+	CompiledArray(CompiledArray<X>&& other);
+	CompiledArray<X>& operator=(const CompiledArray<X>& other);
+	CompiledArray<X>& operator=(CompiledArray<X>&& other);
+
+	//View count elements owned by someone else
+	void view(X* elements, size_t count);
+
+	//Own count copies of val
+	void assign(size_t count, const X& val);
+
+	//Own count elements, keeping existing ones
+	void resize(size_t count);
+
+	//Own nothing
+	void clear();
+
+	//Check if elements are owned by someone else
+	bool isView();
+
+	//Get the number of elements
+	size_t size() const;
+
+	//Get the first element
+	X* data();
+
+	//Get element at index
+	X& operator[](size_t index);
+};
+
+// CompiledGraph is a flat snapshot of the topology of an EvolutionGNN
+// Connections are grouped by their outNode in contiguous arrays (CSR),
+// so the node at position n reads connections [rowOffsets[n], rowOffsets[n + 1])
+// Input and output nodes keep their ids as positions, hidden nodes are placed
+// by NodeOrder, so values read by neighbouring rows are close in memory
+// Buffers of all connections are selected by a single step parity:
+// buffers[parity] is read and buffers[!parity] is written, so flipping
+// buffers is O(1) while every connection keeps its own logical state
+// A CompiledGraph can carry several independent lanes of states, which are
+// stored next to each other (connection i, lane b is at i * lanes + b)
+// Each row keeps a few free slots, and mirrors the swap and pop of inCon,
+// so single connections can be added and removed without compiling again
+// save() writes the layout as a model file, and map() executes one in place
+// In event driven mode runEvents() only runs nodes reading a value that changed
+// in the previous step, see setEventDriven()
+// Values of nodes are kept in Acc and rounded to T when written to buffers
+template <class T, class Activation = TanhActivation, class Acc = T>
+class CompiledGraph {
+protected:
+	int inputCount;		//Number of input nodes
+	int outputCount;	//Number of output nodes
+	int nodeCount;		//Number of node slots, including unused ids
+	int lanes;			//Number of independent states carried by each node and connection
+
+	CompiledArray<int> rowOffsets;		//Offsets of incoming connections of each node, size nodeCount + 1
+	CompiledArray<int> rowEnds;			//End of live connections of each node, the rest of a row is free
+	int liveCount;						//Number of live connections
+	CompiledArray<int> sources;			//inNodeId of each connection, -1 for free slots
+	CompiledArray<T> weights;			//Weight of each connection
+	CompiledArray<T> buffers[2];		//Read and write buffer of each connection, selected by parity
+	CompiledArray<char> bufferState;	//useABuffer of each connection at compile time, used by writeBack()
+	bool parity;				//Read side of buffers, flipped once per step
+	bool flipped;				//Whether parity has flipped an odd number of times since compile
+
+	//Latest value of each node and lane, kept in Acc
+	//Input nodes hold their input, other nodes hold their activation
+	vector<Acc> values;
+
+	NodeOrder nodeOrder;	//How hidden nodes are placed
+	vector<int> position;	//Position of each node id in rows and values
+	vector<int> order;		//Node id at each position
+
+	//Connection each entry was compiled from, used to write states back
+	//A mapped graph holds indices in EvolutionGNN::con of the saved network instead
+	CompiledArray<ConnectionHandle> connections;
+
+	//File viewed by the arrays after map(), kept alive while any array views it
+	shared_ptr<MappedFile> mapping;
+
+	//Accuracy of tanh
+	TanhMode tanhMode;
+
+	//Positions of nodes of each ActivationId, sorted
+	//Empty when every node uses Activation
+	vector<vector<int>> activationGroups;
+
+	//State of event driven execution, see runEvents()
+	bool eventDriven;			//Whether EvolutionGNN steps by runEvents()
+	Acc epsilon;				//Changes of a value up to epsilon are not propagated
+	bool eventsReady;			//Whether the arrays below match the topology
+	int warmSteps;				//Steps left that run every node, until buffers follow values
+	vector<int> outOffsets;		//Slots written by each position are outSlots[outOffsets[p] .. outOffsets[p + 1])
+	vector<int> outSlots;
+	vector<int> slotRows;		//Position reading each slot
+	vector<int> alwaysActive;	//Positions reading output nodes, whose slots are never written
+	vector<unsigned char> groupOf;	//Index in activationGroups of each position
+	vector<Acc> propagated;		//Value of each position when its change was last propagated
+	vector<int> changed;		//Positions whose value changed in this step
+	vector<int> previous;		//Positions whose value changed in the previous step
+	vector<int> active;			//Positions run in this step
+	vector<unsigned int> stamp;	//Step a position was last added to active
+	unsigned int eventStep;		//Number of runEvents()
+
+	//State of settle mode, see runSettled()
+	bool settling;				//Whether EvolutionGNN steps by runSettled()
+	bool settleReady;			//Whether the arrays below match the topology
+	vector<int> settleOrder;	//Positions by topological order of strongly connected components
+	vector<char> crossSlot;		//Whether a slot reads a node of an earlier component
+
+	//Apply activation function on positions [startId, endId)
+	void activate(int startId, int endId);
+
+	//Apply activation function on positions in list
+	void activate(const vector<int>& list);
+
+	//Build the arrays used by runEvents() and start with warm steps
+	void prepareEvents();
+
+	//Build settleOrder and crossSlot
+	void prepareSettle();
+
+	//Fill activationGroups from ActivationId of each node id
+	void groupActivations(const vector<unsigned char>& activations);
+
+	//Fill position and order by nodeOrder
+	void placeNodes(ConnectionPool<T>& pool, vector<InputGraphNode<T>>& inputNodes, vector<OutputGraphNode<T>>& outputNodes, vector<GraphNode<T>>& graphNodes);
+
+public:
+
+	//Construct empty CompiledGraph
+	CompiledGraph();
+
+	//Freeze the topology and states of the given nodes
+	//Every lane starts with the states currently held by the nodes
+	//activations holds ActivationId of each node, missing ones use Activation
+	void compile(ConnectionPool<T>& pool, vector<InputGraphNode<T>>& inputNodes, vector<OutputGraphNode<T>>& outputNodes, vector<GraphNode<T>>& graphNodes, int lanes = 1, const vector<unsigned char>& activations = {});
+
+	//Release everything
+	void clear();
+
+	//Get the number of node slots
+	int getNodeSize();
+
+	//Get the number of live connections
+	int getConnectionSize();
+
+	//Get the number of connection slots, including free ones
+	int getSlotSize();
+
+	//Get the number of incoming connections of the node at a position
+	int getInDegree(int position);
+
+	//Set how hidden nodes are placed by the next compile()
+	void setNodeOrder(NodeOrder order);
+
+	//Get position of a node id
+	int getPosition(int id);
+
+	//Append a Connection to the row of its outNode, mirroring GraphNode::addInCon()
+	//Return false if the row is full, then the graph has to be compiled again
+	bool addConnection(ConnectionPool<T>& pool, ConnectionHandle handle);
+
+	//Remove connection at inConIndex of a node, mirroring GraphNode::removeInCon()
+	void removeConnection(int id, int inConIndex);
+
+	//Check if more than half of the slots are free, so compiling again saves memory and time
+	bool needsCompaction();
+
+	//Get the number of lanes
+	int getLaneSize();
+
+	//Get value of a node in given lane
+	T getValue(int id, int lane = 0);
+
+	//Set value of a node in given lane, used to set inputs
+	void setValue(int id, T val, int lane = 0);
+
+	//Get current read side of buffers
+	bool getParity();
+
+	//Set accuracy of tanh
+	void setTanhMode(TanhMode mode);
+
+	//Calculate values of nodes at positions [startId, endId), reading buffers[parity]
+	void runNodes(int startId, int endId, bool parity);
+
+	//Write value of inNode into buffers[!parity] of connections [start, end)
+	//Should be called after runNodes() finished for all nodes
+	void writeConnections(int start, int end, bool parity);
+
+	//Flip buffers of all connections
+	void flipBuffer();
+
+	//Let EvolutionGNN step by runEvents() instead of runNodes() and writeConnections()
+	//With epsilon 0, results equal the dense step exactly when tanh is TANH_EXACT
+	//A larger epsilon skips small changes, so values may differ by about epsilon
+	void setEventDriven(bool enabled, T epsilon = T(0));
+
+	//Check if EvolutionGNN steps by runEvents()
+	bool isEventDriven();
+
+	//Same as runNodes() and writeConnections() over all nodes, reading buffers[parity],
+	//but only runs nodes reading a node whose value changed in the previous step, and
+	//only writes connections of nodes changed in this or the previous step, as the
+	//other buffer still holds the value written two steps ago
+	//The first two steps after compiling or editing run every node
+	//Only a single lane is supported, return the number of connections read
+	long long runEvents(bool parity);
+
+	//Get number of nodes run by the last runEvents()
+	int getActiveSize();
+
+	//Let EvolutionGNN step by runSettled() instead of runNodes() and writeConnections()
+	void setSettling(bool enabled);
+
+	//Check if EvolutionGNN steps by runSettled()
+	bool isSettling();
+
+	//Run every node in topological order of strongly connected components, then write
+	//connections like writeConnections()
+	//Slots from an earlier component read the value of their source in this step,
+	//slots inside a component and out of output nodes read buffers[parity] as usual
+	void runSettled(bool parity);
+
+	//Write buffers and buffer states of lane 0 back to the Connections
+	void writeBack(ConnectionPool<T>& pool);
+
+	//Write lane 0 as a model file of version 2 or later, see ModelSection
+	//Version 2 stores values rounded to T
+	//Only valid for a compiled graph, not a mapped one
+	void save(ConnectionPool<T>& pool, fstream& out, const vector<unsigned char>& activations, int version = MODEL_VERSION);
+
+	//Execute a model file in place with a single lane
+	//Arrays view the private mapping, so only pages that get written are copied
+	//Return false if the file is not a valid model file for T
+	bool map(const string& path);
+
+	//Check if arrays view a mapped file
+	bool isMapped();
+};
+
+//Number of intervals of the tanh table used by QuantizedGraph
+const int QUANTIZE_TABLE_SIZE = 4096;
+
+//tanh is read from the table in [-QUANTIZE_TABLE_RANGE, QUANTIZE_TABLE_RANGE], and is
+//within half a step of 16 bit values from -1 or 1 outside
+const double QUANTIZE_TABLE_RANGE = 8.0;
+
+// QuantizedGraph is a fixed-point copy of a network for inference, with 8 or 16 bit
+// weights, values and connection buffers, so a step moves a fraction of the bytes
+// Each kind has a single scale for the whole network:
+//   value = q * range / qmax, weight = q * weightScale, where qmax = 2^(bits - 1) - 1
+// Sums are accumulated in integers, 32 bit for 8 bit values and 64 bit for 16 bit ones,
+// where two products could overflow 32 bit, and are only converted back once per node
+// tanh is read from a table with linear interpolation, other activations are calculated
+// Values beyond range saturate, so range should cover the inputs and activations
+// Rows are laid out by node id like CompiledGraph with ORDER_ID, without free slots
+template <class T, class Activation = TanhActivation>
+class QuantizedGraph {
+protected:
+	int bits;			//Bits of each weight, value and buffer, 8 or 16
+	int inputCount;		//Number of input nodes
+	int outputCount;	//Number of output nodes
+	int nodeCount;		//Number of nodes
+
+	double valueScale;		//Value of one step of values and buffers
+	double weightScale;		//Value of one step of weights
+
+	vector<int> rowOffsets;			//Incoming connections of node n are [rowOffsets[n], rowOffsets[n + 1])
+	vector<int> sources;			//inNodeId of each connection
+	vector<char> weights;			//Weight of each connection, bits / 8 bytes each
+	vector<char> buffers[2];		//Read and write buffer of each connection, selected by parity
+	vector<char> values;			//Latest value of each node
+	vector<unsigned char> activations;	//ActivationId of each node, never ACTIVATION_DEFAULT
+	bool parity;		//Read side of buffers, flipped once per step
+	bool flipped;		//Whether parity has flipped an odd number of times since build
+
+	//Connection each entry was built from and its buffer state then, used by writeBack()
+	vector<ConnectionHandle> connections;
+	vector<char> bufferState;
+
+	//Get the interpolated tanh table, shared by all graphs
+	static const vector<float>& getTanhTable();
+
+	//Activate the sum of a node and round it to a value
+	template <class Q>
+	Q activate(int id, double sum);
+
+	//Round to a value, saturating at range
+	template <class Q>
+	Q quantizeValue(double val);
+
+	//runNodes() and writeConnections() for values of type Q, summed in Acc
+	template <class Q, class Acc>
+	void runNodesAs();
+	template <class Q>
+	void writeConnectionsAs();
+
+public:
+
+	//Construct empty QuantizedGraph
+	QuantizedGraph();
+
+	//Copy the topology and states of the given nodes with values of bits in [-range, range]
+	//activations holds ActivationId of each node, missing ones use Activation
+	//Return false if bits is neither 8 nor 16
+	bool build(ConnectionPool<T>& pool, vector<InputGraphNode<T>>& inputNodes, vector<OutputGraphNode<T>>& outputNodes, vector<GraphNode<T>>& graphNodes, int bits, T range, const vector<unsigned char>& activations = {});
+
+	//Release everything
+	void clear();
+
+	//Get bits of each value, 0 if not built
+	int getBits();
+
+	//Get value of a node
+	T getValue(int id);
+
+	//Set value of a node, used to set inputs
+	void setValue(int id, T val);
+
+	//Calculate values of all nodes, reading buffers[parity]
+	void runNodes();
+
+	//Write value of inNode into buffers[!parity] of all connections
+	void writeConnections();
+
+	//Flip buffers of all connections
+	void flipBuffer();
+
+	//Write buffers and buffer states back to the Connections, rounded to the steps of values
+	void writeBack(ConnectionPool<T>& pool);
+
+	//Get number of bytes of weights and buffers of a connection
+	int getConnectionBytes();
+};
+
+// EvolutionGNN is the entire envolutional graph neural network
+// It manages a list of GraphNode stored by it's id
+// It manages a list of connections used in the graph neural network
+// It also manages a list of GraphNodes that acted as input
+// It also manages a list of GraphNodes that acted as output
+// Weights and buffers are stored as T, while sums and activations are calculated in Acc,
+// e.g. EvolutionGNN<_Float16, TanhActivation, float> halves the bytes of connections
+template <class T, class Activation = TanhActivation, class Acc = T>
+class EvolutionGNN {
+protected:
+
+	//All input nodes, fixed, and will not be changed
+	vector<InputGraphNode<T>> inputNodes;
+
+	//All output nodes, fixed, and will not be changed
+	vector<OutputGraphNode<T>> outputNodes;
+
+	//All available nodes inside the graph excluding inputNodes and outputNodes
+	//Index of hidden nodes will starts from |inputNodes.size() + outputNodes.size()|
+	//Hidden node of id is stored at graphNodes[id - inputNodes.size() - outputNodes.size()]
+	vector<GraphNode<T>> graphNodes;
+
+	//Ids of removed hidden nodes, reused by addNodes()
+	//A removed node stays in graphNodes without any connection, and leaves this list
+	//when addConnection() connects it again
+	vector<int> freeNodes;
+
+	//Storage of all Connections, and handles of them in the order they were added
+	ConnectionPool<T> connectionPool;
+	vector<ConnectionHandle> con;
+
+	//Total number of nodes
+	int nodeCount;
+
+	//Number of thread used to run
+	int threadCount;
+
+	//Flat representation used by run() and flipBuffer() after compile()
+	CompiledGraph<T, Activation, Acc> compiled;
+
+	//Whether run() and flipBuffer() execute on compiled
+	bool useCompiled;
+
+	//Whether compiled still matches the current topology
+	bool compiledValid;
+
+	//Number of samples run side by side by the compiled graph
+	int batchSize;
+
+	//Accuracy of tanh used by the compiled graph
+	TanhMode tanhMode;
+
+	//Placement of hidden nodes in the compiled graph
+	NodeOrder nodeOrder;
+
+	//ActivationId of each node, nodes out of range use Activation
+	//Empty when every node uses Activation
+	vector<unsigned char> activations;
+
+	//Random stream used by mutate(), inherit() and addRandomConnection()
+	//Seeded by rand() on construction
+	EvoRandom random;
+
+	//Load a model file of version 2
+	bool loadModel(string path);
+
+	//Call work(start, end) on blocks covering [0, count)
+	//Blocks run on the WorkerPool when count is large enough to be worth it
+	template <class Work>
+	void forBlocks(int count, const Work& work);
+
+	//Link count Connections created at handles [first, first + count) at once
+	//inCon and outCon of every node are filled by a counting sort over node ids,
+	//so each list keeps the order of handles
+	//indices gives the place of each Connection in con, nullptr keeps the order of handles
+	//Return false if a Connection refers to a negative id
+	bool linkConnections(ConnectionHandle first, int count, const int* indices = nullptr);
+
+	//Rebuild compiled if topology changed since last compile
+	void prepareCompiled();
+
+	//Copy states back from compiled and mark it outdated
+	//Called by every function that changes the topology
+	void invalidateCompiled();
+
+	//Run the compiled graph, should be called by run()
+	void runCompiled();
+
+	//Fill state with the latest value of every node the next step depends on,
+	//used by runUntilStable()
+	void captureState(vector<T>& state);
+
+	//Get input, output or hidden node by id
+	//Missing hidden nodes up to id are created
+	GraphNode<T>& getNode(int id);
+
+	//Worker threads used by multi-threaded run() and flipBuffer()
+	//Created on first use unless provided by setWorkerPool()
+	shared_ptr<WorkerPool> workerPool;
+
+	//Get workerPool, create it if needed
+	WorkerPool& prepareWorkerPool();
+
+	//Node id boundaries of chunks with roughly equal work, size chunks + 1
+	//Work of a node is its number of connections, so hubs get chunks of their own
+	//Empty until preparePartition(), cleared whenever the topology changes
+	vector<int> partition;
+
+	//Whether workers claim chunks one by one instead of running a fixed chunk each
+	bool dynamicScheduling;
+
+	//Time spent in run(), flipBuffer() and runSteps(), see PerfCounters
+	PerfCounters perf;
+
+	//Whether the compiled graph only runs nodes whose inputs changed, see setEventDriven()
+	bool eventDriven;
+
+	//Changes of values up to eventEpsilon are not propagated in event driven mode
+	T eventEpsilon;
+
+	//Whether run() and flipBuffer() only visit nodes that can affect an output, see setPruning()
+	bool pruning;
+
+	//Whether liveNodes matches the topology
+	bool liveValid;
+
+	//Ids of nodes visited in pruning mode, ascending within two parts:
+	//nodes reachable from an input node, an output node or a cycle, then hidden nodes fed by none,
+	//which are only visited for pruneWarmSteps until their values settle
+	vector<int> liveNodes;
+
+	//Number of leading liveNodes visited by the current step
+	int liveCount;
+
+	//Number of liveNodes reachable from an input node, an output node or a cycle
+	int fedCount;
+
+	//Steps left that visit all liveNodes
+	int pruneWarmSteps;
+
+	//Fill liveNodes from the topology, if not filled already
+	//Nodes with a path to some output are found by a reverse BFS from outputNodes,
+	//nodes fed by neither an input nor a cycle by removing nodes without in-coming
+	//connections repeatedly, which also gives their depth
+	void prepareLiveNodes();
+
+	//Run liveNodes [start, end)
+	void runLiveNodes(int start, int end);
+
+	//Flip buffers of liveNodes [start, end)
+	void flipLiveNodes(int start, int end);
+
+	//Run a single input, output or hidden node
+	void runNode(int id);
+
+	//Whether run() carries values across connections between strongly connected
+	//components within one step, see setSettling()
+	bool settling;
+
+	//Whether settleOrder matches the topology
+	bool settleValid;
+
+	//Node ids by topological order of strongly connected components
+	vector<int> settleOrder;
+
+	//Connections from settleOrder[i] to a later component are crossCon[crossOffsets[i] .. crossOffsets[i + 1])
+	vector<int> crossOffsets;
+	vector<ConnectionHandle> crossCon;
+
+	//Fill settleOrder and crossCon from the topology, if not filled already
+	void prepareSettle();
+
+	//Run all nodes in settleOrder, should be called by run()
+	void runSettled();
+
+	//Fixed-point copy used by run() and flipBuffer() after quantize()
+	QuantizedGraph<T, Activation> quantized;
+
+	//Bits of values of quantized, 0 if run() does not use it
+	int quantizeBits;
+
+	//Largest magnitude of values of quantized
+	T quantizeRange;
+
+	//Whether quantized still matches the current topology
+	bool quantizedValid;
+
+	//Rebuild quantized if topology changed since it was built
+	void prepareQuantized();
+
+	//Copy states back from quantized and mark it outdated
+	void invalidateQuantized();
+
+	//Build partition for given number of threads, if not built already
+	void preparePartition(int numOfThread);
+
+	//Call work(startId, endId) on the chunks of worker id
+	//With dynamic scheduling, chunks are claimed through next until none is left
+	template <class Work>
+	void runChunks(int id, int numOfThread, atomic<int>& next, const Work& work);
+
+public:
+
+	//Construct empty EvolutionGNN
+	EvolutionGNN(int threadCount = -1);
+
+	//Constructor with known input and output size
+	EvolutionGNN(int inputCount, int outputCount, int threadCount = -1);
+
+	//Constructor by inheritance from parents
+	EvolutionGNN(EvolutionGNN<T, Activation, Acc>& parentA, EvolutionGNN<T, Activation, Acc>& parentB, double AConRate = 0.7, double BConRate = 0.3, bool inheritMemory = false);
+
+	//Just like Constructor, initialize with known input and output size
+	void initialize(int inputCount, int outputCount, int threadCount = -1);
+
+	//Get the number of input
+	int getInputSize();
+
+	//Get the number of hidden nodes, excluding removed ones
+	int getHiddenSize();
+
+	//Get the number of output
+	int getOutputSize();
+
+	//Get the number of connections
+	int getConnectionSize();
+
+	//Clean up everything
+	void cleanUp();
+
+	//Set input to each inputNode
+	//In batched mode the value is set for every sample
+	void setInput(int index, T val);
+
+	//Set input of a single sample in batched mode, lane 0 without batching
+	//Return false if lane is not below getBatchSize()
+	bool setInput(int lane, int index, T val);
+
+	//Set inputs of all samples in batched mode, batch[lane][index]
+	//Lanes beyond getBatchSize() are ignored
+	void setInputs(const vector<vector<T>>& batch);
+
+	//Run batch.size() samples side by side in one sweep over the topology
+	//Each sample keeps its own buffers, samples start with the current states
+	//Batched mode runs on the compiled graph, compile() is called if needed
+	void setBatchSize(int lanes);
+
+	//Get number of samples run side by side
+	int getBatchSize();
+
+	//Set accuracy of tanh used by the compiled graph
+	//TANH_FAST activates whole blocks of nodes with SIMD, see FastTanh
+	//GraphNode::run() always uses exact tanh()
+	void setTanhMode(TanhMode mode);
+
+	//Get accuracy of tanh used by the compiled graph
+	TanhMode getTanhMode();
+
+	//Reorder hidden nodes inside the compiled graph for memory locality
+	//Node ids seen from outside do not change, and results stay the same
+	void setNodeOrder(NodeOrder order);
+
+	//Get placement of hidden nodes in the compiled graph
+	NodeOrder getNodeOrder();
+
+	//Give a single node its own activation function (ActivationId)
+	//ACTIVATION_DEFAULT makes the node use Activation again
+	void setActivation(int id, int activation);
+
+	//Get ActivationId of a node
+	int getActivation(int id);
+
+	//Restart the random stream of this network from a seed
+	void seed(unsigned long long seed);
+
+	//Get the random stream of this network
+	EvoRandom& getRandom();
+
+	//Replace the random stream of this network, e.g. by EvoRandom::split()
+	void setRandom(const EvoRandom& random);
+
+	//Flip buffer for next run
+	void flipBuffer();
+
+	//Flip buffer in a multi-threaded way, should be called by flipBuffer()
+	void thread_flipBuffer(int startId, int endId, int dummy = 0);
+
+	//Run the whole neural network
+	void run();
+
+	//Run in a multi-threaded way, should be called by run()
+	void thread_run(int startId, int endId, int dummy = 0);
+
+	//Run and flip buffer for given number of steps
+	//Same as calling run() and flipBuffer() steps times, but keeps worker threads busy
+	//in between, so each step only costs two barrier crossings
+	void runSteps(int steps);
+
+	//Run and flip buffer until the values of all nodes repeat, at most maxSteps times
+	//Values are compared to a snapshot moved ahead at doubling intervals (Brent's method),
+	//so a fixed point or cycle is found within about twice the steps it takes to appear
+	//Values differing by up to epsilon count as equal, epsilon 0 compares exact bits
+	//Return the period, 1 for a fixed point and 0 if nothing repeated within maxSteps
+	//steps gets the number of steps run, if given
+	int runUntilStable(int maxSteps = 1000, T epsilon = T(0), int* steps = nullptr);
+
+	//Determine number of thread to run
+	int determineNumberOfThread();
+
+	//Use a WorkerPool which can be shared with other networks
+	void setWorkerPool(shared_ptr<WorkerPool> pool);
+
+	//Get WorkerPool used by this network, create it if needed
+	shared_ptr<WorkerPool> getWorkerPool();
+
+	//Freeze current topology into a flat CompiledGraph
+	//run() and flipBuffer() will execute on it from now on, and it will be
+	//rebuilt automatically after the topology is edited
+	//A quantized copy is written back and dropped, see dequantize()
+	void compile();
+
+	//Write states back to the GraphNodes and stop using the compiled graph
+	void decompile();
+
+	//Check if run() and flipBuffer() execute on the compiled graph
+	bool isCompiled();
+
+	//Copy buffers and outputs from the compiled graph to Connections and GraphNodes
+	void syncCompiled();
+
+	//Task arranger function, set protion of tasks to threads
+	double taskArranger(double x);
+
+	//Let workers claim small chunks of nodes one by one instead of a fixed share each
+	//Helps when a few expensive nodes still leave some workers behind
+	void setDynamicScheduling(bool dynamic);
+
+	//Check if workers claim chunks of nodes one by one
+	bool getDynamicScheduling();
+
+	//Get counters of time spent in run(), flipBuffer() and runSteps()
+	//Only filled if T_EVOLUTIONGRAPHNN_PERF_COUNTERS is defined, see PerfCounters
+	PerfCounters& getPerfCounters();
+
+	//Only run nodes whose in-coming values changed by more than epsilon in the last step
+	//Settled regions of the network cost nothing, so a step costs about the number of
+	//connections of changing nodes instead of all of them
+	//Runs on the compiled graph, compile() is called if needed, on the calling thread,
+	//and only without batching; see CompiledGraph::runEvents()
+	void setEventDriven(bool enabled, T epsilon = T(0));
+
+	//Check if event driven mode is set
+	bool isEventDriven();
+
+	//Get number of nodes run by the last step in event driven mode
+	int getActiveSize();
+
+	//Only visit nodes with a path to some output node in run() and flipBuffer(),
+	//and once their values settled, only those reachable from an input node, an output
+	//node or a cycle
+	//Outputs stay exactly the same, skipped nodes keep their states and resume from them
+	//when an edit connects them to an output again
+	//The analysis is cached and repeated after the topology changed
+	//Applies to GraphNodes, the compiled graph still runs every node
+	void setPruning(bool enabled);
+
+	//Check if pruning mode is set
+	bool isPruning();
+
+	//Get number of nodes visited by the next step in pruning mode
+	int getLiveSize();
+
+	//Run nodes in topological order of strongly connected components, so a value crosses
+	//every connection between two components within the same step, while connections
+	//inside a cycle keep the double buffer and take a step as before
+	//A feed-forward network reaches its outputs after one step instead of one per layer
+	//Out-going connections of output nodes are never written and stay double buffered
+	//Runs on the calling thread, also on the compiled graph; pruning is not applied
+	void setSettling(bool enabled);
+
+	//Check if settle mode is set
+	bool isSettling();
+
+	//Run on a fixed-point copy with bits of 8 or 16 from now on, see QuantizedGraph
+	//Values beyond range saturate, so it should cover inputs and activations
+	//States are written back to Connections, rounded, before they are read or saved
+	//and when the topology changes, after which the copy is built again
+	//Runs on the calling thread with a single sample, so the compiled graph is written
+	//back and dropped, see decompile(), until compile() drops the copy again
+	//Return false if bits is neither 8 nor 16
+	bool quantize(int bits = 8, T range = T(1));
+
+	//Write states back to the Connections and stop using the fixed-point copy
+	void dequantize();
+
+	//Get bits of values used by run(), 0 if not quantized
+	int getQuantizeBits();
+
+	//Get output from each outputNode
+	//In batched mode this is the output of the first sample
+	T getOutput(int index);
+
+	//Get output of a single sample in batched mode, lane 0 without batching
+	//Reads the engine run() uses and never compiles by itself
+	//Return 0 if lane is not below getBatchSize()
+	T getOutput(int lane, int index);
+
+	//Get outputs of all samples in batched mode, batch[lane][index]
+	//Without batching batch holds the outputs of a single sample
+	void getOutputs(vector<vector<T>>& batch);
+
+	//Add hidden neuron, return ids of the added nodes
+	//Ids of removed nodes are reused first, so an id is not always the largest one
+	vector<int> addNodes(int count = 1);
+
+	//Remove a hidden neuron and all of its connections
+	void removeNode(int id);
+
+	//Add connection between nodes
+	// node1 -------> node2
+	void addConnection(int node1, int node2, T weight = T(1), T ABuffer = T(0), T BBuffer = T(0), bool useABuffer = false);
+
+	//Add connection between nodes with random input
+	// node1 -------> node2 (node2 should not be input nodes)
+	// weight following uniform distribution in [-10, 10)
+	void addRandomConnection(int count = 1);
+
+	//Remove a connection given by the index in O(1)
+	//The last connection is moved into its place
+	void removeConnection(int index);
+
+	//Remove useless connections that are not connected to any nodes
+	void removeDisconnectedConnections();
+
+	//Save to file
+	//Version 2 and later write a binary header and aligned sections, see ModelHeader,
+	//which CompiledGraph::map() can execute in place, version 3 also records T and Acc
+	//Version 1 writes the text header and packed connections of older releases
+	void save(string filename = "./out.TEvoGNN", int version = MODEL_VERSION);
+
+	//Load from file of any version
+	//Version 2 and later restore the order of connections in con and in every inCon
+	bool load(string path = "./out.TEvoGNN");
+
+	//Append nodes, connections and their states to out, compressed by ArchiveCodec
+	//With a base, connections are matched to connections of base between the same nodes,
+	//and only their differences are written
+	//The order of inCon and outCon, removed nodes and the random stream are written too,
+	//so a decoded network evolves exactly like this one
+	void encode(vector<char>& out, EvolutionGNN<T, Activation, Acc>* base = nullptr);
+
+	//Rebuild from data written by encode() with the same base
+	//Records without order and random stream keep the current stream
+	//Return false if data is not a valid record
+	bool decode(const char* data, size_t size, EvolutionGNN<T, Activation, Acc>* base = nullptr);
+
+	//Fill a MinHash sketch of the pairs (inNodeId, outNodeId) of all connections
+	//Each bin holds the smallest hash of the pairs falling into it, so sketches of two
+	//networks agree in about the fraction of the pairs they share
+	void sketch(vector<unsigned int>& bins, int count = 64);
+
+	//Cross bread
+	//Accept two parents and selectively inherit their structures
+	//Parents are only read, random numbers come from this network's stream
+	//inputNodes = max(parentA.inputNodes.size(), parentB.inputNodes.size())
+	//outputNodes = max(parentA.inputNodes.size(), parentB.inputNodes.size())
+	//graphNodes = max(parentA.graphNodes.size(), parentB.graphNodes.size())
+	//AConRate: Percentage of connections been selected from parentA
+	//BConRate: Percentage of connections been selected from parentB
+	//inheritMemory: Select weither value and buffer states will be passed
+	void inherit(EvolutionGNN<T, Activation, Acc>& parentA, EvolutionGNN<T, Activation, Acc>& parentB, double AConRate = 0.7, double BConRate = 0.3, bool inheritMemory = false);
+
+	//Mutate itself by deleting connections/creating new connections/creating new nodes
+	// newConRate to create new connection
+	// deleteConRate to delete connection
+	// newNodeRate to create new node
+	// repeatRate to mutate again (follows Geometric distributions)
+	// activationRate to give a random node a random activation function
+	//Random numbers come from this network's stream, see seed()
+	void mutate(double newConRate = 0.5, double deleteConRate = 0.5, double newNodeRate = 0.0001, double repeatRate = 0.5, double activationRate = 0.0);
+
+	//Get the DOT representation for Graphviz
+	string getDOT();
+
+	//Save the DOT representation for Graphviz
+	void saveDOT(string filename = "model.dot");
+
+	//Testing function
+	void test(bool mt = false) {
+		srand(42);
+		cleanUp();
+		if (mt)initialize(1, 1);
+		else
+			initialize(1, 1, 1);
+
+		////Add extra 5 nodes
+		//for (int i = 0; i < 5; ++i)
+		//	addNodes();
+		////Add connections
+		//addConnection(0, 2, 30.0);
+		//addConnection(2, 3, 30.0);
+		//addConnection(3, 4, 30.0);
+		//addConnection(4, 5, 30.0);
+		//addConnection(5, 6, 30.0);
+		//addConnection(6, 1, 1.0);
+		////Loop back
+		//addConnection(6, 2, 30.0);
+
+
+		//Random initializations
+		for (int i = 0; i < 1000; ++i)
+			addNodes();
+		for (int i = 0; i < 10000; ++i)
+			addConnection(rand() % nodeCount, rand() % nodeCount, rand() % 2001 / 1000.0 - 1.0);
+
+
+		//OR gate
+		//for (int i = 0; i < 4; ++i)
+		//	addNodes();
+		////Add connections
+		//addConnection(0, 2);
+		//addConnection(0, 3);
+		//addConnection(2, 4, 40.0);
+		//addConnection(3, 4, 40.0);
+		//addConnection(5, 5, 40.0, 1.0, 1.0);	//Bias connection, constantly 1.0
+		//addConnection(5, 4, -20.0);				//Bias connection
+		//addConnection(4, 1, 40.0);
+
+		////AND gate
+		//for (int i = 0; i < 6; ++i)
+		//	addNodes();
+		////Add connections
+		//addConnection(0, 2);
+		//addConnection(0, 3);
+		//addConnection(2, 4, -30.0);
+		//addConnection(3, 5, -30.0);
+		//addConnection(4, 6, 30.0);
+		//addConnection(5, 6, 30.0);
+		//addConnection(6, 7, -30.0);
+		//addConnection(7, 1, 1.0);
+
+		removeDisconnectedConnections();
+
+		//Set initial input
+		setInput(0, 1);
+		run();
+		flipBuffer();
+
+		for (int i = 0; i < 100; ++i) {
+			//setInput(0, 0);
+			run();
+			flipBuffer();
+			printf("%7.3f", getOutput(0));
+			if (i % 15 == 0) cout << endl;
+		}
+		cout << endl << endl;
+
+		cout << "Writing to file..." << endl;
+		if (!mt) {
+			save("./single_thread.TEvoGNN");
+			load("./single_thread.TEvoGNN");
+		}
+		else {
+			save("./multi_thread.TEvoGNN");
+			load("./multi_thread.TEvoGNN");
+		}
+		cout << "Done!" << endl;
+
+		cout << "Continue simulation after reloading from file" << endl; srand(42);
+		removeDisconnectedConnections();
+
+		for (int i = 0; i < 100; ++i) {
+			setInput(0, 0);
+			run();
+			flipBuffer();
+			printf("%7.3f", getOutput(0));
+			if (i % 15 == 0) cout << endl;
+		}
+		cout << endl << endl << endl;;
+	}
+
+	friend ostream;
+};
+
+//Show info of a EvolutionGNN
+template <class T, class Activation, class Acc>
+ostream& operator<<(ostream& o, EvolutionGNN<T, Activation, Acc>& egnn) {
+	o << "Evolution Graph Neural Network" << endl;
+	o << "\tInput Nodes:\t" << egnn.getInputSize() << endl;
+	o << "\tHidden Nodes:\t" << egnn.getHiddenSize() << endl;
+	o << "\tOutput Nodes:\t" << egnn.getOutputSize() << endl;
+	o << "\tConnections:\t" << egnn.getConnectionSize();
+	return o;
+}
+
+// ArchiveCodec compresses streams of fixed-size values without external libraries
+// Values are byte shuffled, so byte b of every value is stored together,
+// then run-length encoded, so planes of zeros (e.g. unchanged values stored
+// as XOR against a base) and repeated exponents take almost no space
+class ArchiveCodec {
+protected:
+	//Append runs of bytes: h < 128 is followed by h + 1 literal bytes,
+	//h >= 128 is followed by a byte repeated h - 125 times
+	static void encodeRuns(vector<char>& out, const unsigned char* bytes, size_t count);
+
+	//Read count bytes written by encodeRuns()
+	static bool decodeRuns(const unsigned char* data, size_t size, unsigned char* bytes, size_t count);
+
+public:
+
+	//Append count values of width bytes, prefixed by the size of the encoded data
+	static void pack(vector<char>& out, const void* values, size_t count, size_t width);
+
+	//Read count values written by pack() from data at offset, and move offset past them
+	//Return false if data ends early or holds another number of values
+	static bool unpack(const char* data, size_t size, size_t& offset, void* values, size_t count, size_t width);
+
+	//XOR of the bits of two values
+	template <class X>
+	static X xorBits(X a, X b);
+};
+
+//Magic bytes at the start of population archives
+const char ARCHIVE_MAGIC[8] = { 'T', 'E', 'v', 'o', 'P', 'O', 'P', '\0' };
+
+//Version of population archives written by Population::save()
+//Version 2 adds ArchiveState, and the order of node lists and random streams to records
+const unsigned int ARCHIVE_VERSION = 2;
+
+//Genomes sharing fewer connections than this are stored in full by Population::save()
+const double ARCHIVE_MIN_SIMILARITY = 0.2;
+
+// ArchiveHeader starts a population archive
+// It is followed by an ArchiveState from version 2, one record of EvolutionGNN::encode()
+// per genome, and an index with an ArchiveEntry per genome at indexOffset
+struct ArchiveHeader {
+	char magic[8];			//ARCHIVE_MAGIC
+	unsigned int version;	//ARCHIVE_VERSION
+	unsigned int byteOrder;	//MODEL_BYTE_ORDER
+	unsigned int valueSize;	//sizeof(T)
+	unsigned int reserved;	//Always 0
+	long long genomeCount;	//Number of genomes
+	long long generation;	//Population::getGeneration()
+	long long indexOffset;	//Offset of the index from the start of the file
+};
+
+//Random stream and parameters of a population, stored from archive version 2
+struct ArchiveState {
+	unsigned long long random[4];	//State of the population stream
+	int eliteCount;					//Parameters of setSelection()
+	int tournamentSize;
+	double AConRate;				//Parameters of setCrossover()
+	double BConRate;
+	int inheritMemory;
+	int reserved;					//Always 0
+	double newConRate;				//Parameters of setMutation()
+	double deleteConRate;
+	double newNodeRate;
+	double repeatRate;
+	double activationRate;
+};
+
+//Index entry of a genome in a population archive
+struct ArchiveEntry {
+	long long offset;	//Offset of the record from the start of the file
+	long long size;		//Size of the record
+	int base;			//Genome the record is a difference to, -1 if stored in full
+	int reserved;		//Always 0
+	double fitness;		//Fitness from the last evaluate()
+};
+
+// Population holds a group of EvolutionGNN (genomes) evolved together
+// Each generation evaluates every genome with a user given fitness function,
+// keeps the best genomes (elites) and refills the rest with mutated children
+// of tournament selected parents
+// Genomes are evaluated and bred in parallel on a shared WorkerPool, one genome
+// per task; genomes large enough to run multi-threaded on their own are
+// evaluated one at a time afterwards, using every worker of the pool
+template <class T, class Activation = TanhActivation, class Acc = T>
+class Population {
+protected:
+
+	//All genomes, sorted by fitness after reproduce()
+	vector<unique_ptr<EvolutionGNN<T, Activation, Acc>>> genomes;
+
+	//Fitness of each genome from the last evaluate(), higher is better
+	vector<double> fitness;
+
+	//Workers shared by the population and its genomes
+	shared_ptr<WorkerPool> workerPool;
+
+	//Stream split into one stream per genome
+	//Every random decision of a child comes from its own stream, so a generation
+	//only depends on the seed, not on the number of workers
+	EvoRandom random;
+
+	//Number of reproduce() done
+	int generation;
+
+	//Number of best genomes copied to the next generation unchanged
+	int eliteCount;
+
+	//Number of genomes competing for each parent slot
+	int tournamentSize;
+
+	//Parameters passed to inherit()
+	double AConRate;
+	double BConRate;
+	bool inheritMemory;
+
+	//Parameters passed to mutate()
+	double newConRate;
+	double deleteConRate;
+	double newNodeRate;
+	double repeatRate;
+	double activationRate;
+
+	//Pick the fittest of tournamentSize random genomes
+	int selectParent(EvoRandom& random);
+
+	//Estimate the fraction of connections shared by two genomes from their sketches
+	static double similarity(const vector<unsigned int>& a, const vector<unsigned int>& b);
+
+	//Write made by checkpoint() still running in the background, if any
+	future<bool> pendingCheckpoint;
+
+	//Fill state with the random stream and parameters
+	void getArchiveState(ArchiveState& state);
+
+	//Write genomes into an archive at filename+".tmp", and rename it to filename once complete,
+	//so an interrupted write never replaces the previous archive
+	//Genomes are sketched and encoded on pool, or on the calling thread if pool is nullptr
+	static bool writeArchive(const string& filename, vector<unique_ptr<EvolutionGNN<T, Activation, Acc>>>& genomes, const vector<double>& fitness, const ArchiveState& state, long long generation, WorkerPool* pool);
+
+public:
+
+	//Construct empty Population
+	Population(int threadCount = -1);
+
+	//Construct size genomes with known input and output size
+	Population(int size, int inputCount, int outputCount, int threadCount = -1);
+
+	//Just like Constructor, replace all genomes with size new ones
+	void initialize(int size, int inputCount, int outputCount, int threadCount = -1);
+
+	//Get number of genomes
+	int getSize();
+
+	//Get a genome
+	EvolutionGNN<T, Activation, Acc>& getGenome(int index);
+
+	//Get fitness of a genome from the last evaluate()
+	double getFitness(int index);
+
+	//Get the genome with highest fitness from the last evaluate()
+	EvolutionGNN<T, Activation, Acc>& getBest();
+
+	//Get number of generations evolved
+	int getGeneration();
+
+	//Get WorkerPool used by the population
+	shared_ptr<WorkerPool> getWorkerPool();
+
+	//Restart the random stream of the population and every genome from a seed
+	void seed(unsigned long long seed);
+
+	//Set number of elites and tournament size used by reproduce()
+	void setSelection(int eliteCount = 1, int tournamentSize = 3);
+
+	//Set parameters passed to inherit(), see EvolutionGNN::inherit()
+	void setCrossover(double AConRate = 0.7, double BConRate = 0.3, bool inheritMemory = false);
+
+	//Set parameters passed to mutate(), see EvolutionGNN::mutate()
+	void setMutation(double newConRate = 0.5, double deleteConRate = 0.5, double newNodeRate = 0.0001, double repeatRate = 0.5, double activationRate = 0.0);
+
+	//Calculate fitness of every genome in parallel
+	//fitnessFunction may run the genome, but must not change the topology
+	void evaluate(const function<double(EvolutionGNN<T, Activation, Acc>&)>& fitnessFunction);
+
+	//Create next generation from the last evaluate() in parallel
+	//Elites are kept at the front, sorted by fitness
+	//Genomes are decompiled first, so parents can be read by many children at once
+	void reproduce();
+
+	//evaluate() and reproduce() for given number of generations
+	void evolve(const function<double(EvolutionGNN<T, Activation, Acc>&)>& fitnessFunction, int generations = 1);
+
+	//Save all genomes, their fitness and the generation into a single archive
+	//Genomes are encoded in parallel, each one as the difference to a similar genome
+	//stored in full before it, see EvolutionGNN::encode()
+	void save(string filename = "./out.TEvoPOP");
+
+	//Load all genomes from an archive, replacing the current ones
+	//The population continues exactly as the saved one would have, with the same random
+	//streams and parameters; genomes of version 1 archives get new streams split from
+	//the stream of the population
+	bool load(string path = "./out.TEvoPOP");
+
+	//Save in the background, like save()
+	//Genomes are copied before returning, so evolve() may go on right away
+	//Waits for the previous checkpoint first, resume with load()
+	void checkpoint(string filename = "./checkpoint.TEvoPOP");
+
+	//Wait for the last checkpoint() to be written
+	//Return false if writing failed
+	bool waitCheckpoint();
+
+	//Load a single genome from an archive, only it and its base are decoded
+	static bool loadGenome(string path, int index, EvolutionGNN<T, Activation, Acc>& genome);
+};
+
+
+
+
+/***********************************************/
+// Function bodies
+
+template <class T, class Activation, class Acc>
+double Population<T, Activation, Acc>::similarity(const vector<unsigned int>& a, const vector<unsigned int>& b) {
+	//Bins where the minimum hashes agree, out of bins used by either genome
+	int same = 0, used = 0;
+	for (int i = 0; i < a.size() && i < b.size(); ++i) {
+		if (a[i] == UINT_MAX && b[i] == UINT_MAX)continue;
+		++used;
+		if (a[i] == b[i])++same;
+	}
+	return used ? (double)same / used : 0.0;
+}
+
+template <class T, class Activation, class Acc>
+bool Population<T, Activation, Acc>::loadGenome(string path, int index, EvolutionGNN<T, Activation, Acc>& genome) {
+	MappedFile file;
+	if (!file.open(path) || file.getSize() < sizeof(ArchiveHeader))return false;
+
+	const char* data = file.getData();
+	ArchiveHeader header;
+	memcpy(&header, data, sizeof(ArchiveHeader));
+	if (memcmp(header.magic, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC)) || header.version < 1 || header.version > ARCHIVE_VERSION || header.byteOrder != MODEL_BYTE_ORDER || header.valueSize != sizeof(T))return false;
+	if (index < 0 || index >= header.genomeCount || header.indexOffset < 0 || header.indexOffset > file.getSize() || (file.getSize() - header.indexOffset) / sizeof(ArchiveEntry) < header.genomeCount)return false;
+
+	vector<ArchiveEntry> entries(header.genomeCount);
+	memcpy(entries.data(), data + header.indexOffset, entries.size() * sizeof(ArchiveEntry));
+	auto valid = [&](ArchiveEntry& e) {
+		return e.offset >= 0 && e.size >= 0 && e.offset <= file.getSize() && file.getSize() - e.offset >= e.size;
+	};
+
+	ArchiveEntry& entry = entries[index];
+	if (!valid(entry))return false;
+	if (entry.base < 0)return genome.decode(data + entry.offset, entry.size);
+
+	if (entry.base >= index)return false;
+	ArchiveEntry& baseEntry = entries[entry.base];
+	if (baseEntry.base >= 0 || !valid(baseEntry))return false;
+	EvolutionGNN<T, Activation, Acc> base(1);
+	return base.decode(data + baseEntry.offset, baseEntry.size) && genome.decode(data + entry.offset, entry.size, &base);
+}
+
+template <class T, class Activation, class Acc>
+bool Population<T, Activation, Acc>::load(string path) {
+	MappedFile file;
+	if (!file.open(path) || file.getSize() < sizeof(ArchiveHeader))return false;
+
+	const char* data = file.getData();
+	ArchiveHeader header;
+	memcpy(&header, data, sizeof(ArchiveHeader));
+	if (memcmp(header.magic, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC)) || header.version < 1 || header.version > ARCHIVE_VERSION || header.byteOrder != MODEL_BYTE_ORDER || header.valueSize != sizeof(T))return false;
+	if (header.genomeCount < 0 || header.indexOffset < 0 || header.indexOffset > file.getSize() || (file.getSize() - header.indexOffset) / sizeof(ArchiveEntry) < header.genomeCount)return false;
+
+	ArchiveState state;
+	bool stateful = header.version >= 2;
+	if (stateful) {
+		if (file.getSize() < sizeof(ArchiveHeader) + sizeof(ArchiveState))return false;
+		memcpy(&state, data + sizeof(ArchiveHeader), sizeof(ArchiveState));
+	}
+
+	int size = header.genomeCount;
+	vector<ArchiveEntry> entries(size);
+	memcpy(entries.data(), data + header.indexOffset, size * sizeof(ArchiveEntry));
+
+	//Bases are stored in full and before the genomes referring to them
+	for (int i = 0; i < size; ++i) {
+		ArchiveEntry& e = entries[i];
+		if (e.offset < 0 || e.size < 0 || e.offset > file.getSize() || file.getSize() - e.offset < e.size)return false;
+		if (e.base >= 0 && (e.base >= i || entries[e.base].base >= 0))return false;
+	}
+
+	vector<unique_ptr<EvolutionGNN<T, Activation, Acc>>> loaded(size);
+	for (int i = 0; i < size; ++i) {
+		loaded[i] = make_unique<EvolutionGNN<T, Activation, Acc>>(workerPool->getWorkerCount());
+		loaded[i]->setWorkerPool(workerPool);
+	}
+
+	//Genomes stored in full first, then the differences to them
+	atomic<bool> failed(false);
+	for (int pass = 0; pass < 2; ++pass)
+		workerPool->parallelFor(size, [&](int index, int) {
+			ArchiveEntry& e = entries[index];
+			if ((e.base >= 0) != (pass == 1))return;
+			if (!loaded[index]->decode(data + e.offset, e.size, e.base >= 0 ? loaded[e.base].get() : nullptr))
+				failed = true;
+		});
+	if (failed)return false;
+
+	genomes = move(loaded);
+	fitness.resize(size);
+	for (int i = 0; i < size; ++i)
+		fitness[i] = entries[i].fitness;
+	generation = header.generation;
+
+	if (!stateful) {
+		for (int i = 0; i < size; ++i)
+			genomes[i]->setRandom(random.split());
+		return true;
+	}
+
+	random.setState(state.random);
+	setSelection(state.eliteCount, state.tournamentSize);
+	setCrossover(state.AConRate, state.BConRate, state.inheritMemory != 0);
+	setMutation(state.newConRate, state.deleteConRate, state.newNodeRate, state.repeatRate, state.activationRate);
+	return true;
+}
+
+template <class T, class Activation, class Acc>
+void Population<T, Activation, Acc>::save(string filename) {
+	ArchiveState state;
+	getArchiveState(state);
+	writeArchive(filename, genomes, fitness, state, generation, workerPool.get());
+}
+
+template <class T, class Activation, class Acc>
+void Population<T, Activation, Acc>::checkpoint(string filename) {
+	waitCheckpoint();
+
+	//Copies hold the latest states of connections, without the compiled graph
+	int size = genomes.size();
+	auto snapshot = make_shared<vector<unique_ptr<EvolutionGNN<T, Activation, Acc>>>>(size);
+	workerPool->parallelFor(size, [&](int index, int) {
+		(*snapshot)[index] = make_unique<EvolutionGNN<T, Activation, Acc>>(*genomes[index]);
+		(*snapshot)[index]->decompile();
+	});
+
+	//Everything the write needs is captured by value
+	ArchiveState state;
+	getArchiveState(state);
+	vector<double> scores = fitness;
+	long long count = generation;
+	pendingCheckpoint = async(launch::async, [filename, snapshot, scores, state, count]() {
+		return writeArchive(filename, *snapshot, scores, state, count, nullptr);
+	});
+}
+
+template <class T, class Activation, class Acc>
+bool Population<T, Activation, Acc>::waitCheckpoint() {
+	if (!pendingCheckpoint.valid())return true;
+	return pendingCheckpoint.get();
+}
+
+template <class T, class Activation, class Acc>
+void Population<T, Activation, Acc>::getArchiveState(ArchiveState& state) {
+	memset(&state, 0, sizeof(ArchiveState));
+	random.getState(state.random);
+	state.eliteCount = eliteCount;
+	state.tournamentSize = tournamentSize;
+	state.AConRate = AConRate;
+	state.BConRate = BConRate;
+	state.inheritMemory = inheritMemory;
+	state.newConRate = newConRate;
+	state.deleteConRate = deleteConRate;
+	state.newNodeRate = newNodeRate;
+	state.repeatRate = repeatRate;
+	state.activationRate = activationRate;
+}
+
+template <class T, class Activation, class Acc>
+bool Population<T, Activation, Acc>::writeArchive(const string& filename, vector<unique_ptr<EvolutionGNN<T, Activation, Acc>>>& genomes, const vector<double>& fitness, const ArchiveState& state, long long generation, WorkerPool* pool) {
+	int size = genomes.size();
+	auto forEach = [&](const function<void(int)>& work) {
+		if (pool)pool->parallelFor(size, [&](int index, int) { work(index); });
+		else
+			for (int i = 0; i < size; ++i)work(i);
+	};
+
+	//Connections hold their latest states before any genome is read by another
+	vector<vector<unsigned int>> sketches(size);
+	forEach([&](int index) {
+		genomes[index]->syncCompiled();
+		genomes[index]->sketch(sketches[index]);
+	});
+
+	//Each genome is stored as the difference to the most similar earlier genome stored
+	//in full, usually a parent or a sibling, or in full if none is similar enough
+	vector<int> bases(size, -1);
+	for (int i = 0; i < size; ++i) {
+		double best = ARCHIVE_MIN_SIMILARITY;
+		for (int j = 0; j < i; ++j) {
+			if (bases[j] >= 0)continue;
+			double s = similarity(sketches[i], sketches[j]);
+			if (s > best) {
+				best = s;
+				bases[i] = j;
+			}
+		}
+	}
+
+	vector<vector<char>> records(size);
+	forEach([&](int index) {
+		genomes[index]->encode(records[index], bases[index] >= 0 ? genomes[bases[index]].get() : nullptr);
+	});
+
+	ArchiveHeader header;
+	memset(&header, 0, sizeof(ArchiveHeader));
+	memcpy(header.magic, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC));
+	header.version = ARCHIVE_VERSION;
+	header.byteOrder = MODEL_BYTE_ORDER;
+	header.valueSize = sizeof(T);
+	header.genomeCount = size;
+	header.generation = generation;
+
+	vector<ArchiveEntry> entries(size);
+	long long offset = sizeof(ArchiveHeader) + sizeof(ArchiveState);
+	for (int i = 0; i < size; ++i) {
+		entries[i].offset = offset;
+		entries[i].size = records[i].size();
+		entries[i].base = bases[i];
+		entries[i].reserved = 0;
+		entries[i].fitness = i < fitness.size() ? fitness[i] : 0.0;
+		offset += records[i].size();
+	}
+	header.indexOffset = offset;
+
+	string temporary = filename + ".tmp";
+	fstream output(temporary, ios::out | ios::binary);
+	output.write(reinterpret_cast<char*>(&header), sizeof(ArchiveHeader));
+	output.write(reinterpret_cast<const char*>(&state), sizeof(ArchiveState));
+	for (int i = 0; i < size; ++i)
+		output.write(records[i].data(), records[i].size());
+	output.write(reinterpret_cast<char*>(entries.data()), size * sizeof(ArchiveEntry));
+	output.close();
+	if (output.fail()) {
+		remove(temporary.c_str());
+		return false;
+	}
+
+	//rename() does not replace existing files on every platform
+	if (rename(temporary.c_str(), filename.c_str())) {
+		remove(filename.c_str());
+		return !rename(temporary.c_str(), filename.c_str());
+	}
+	return true;
+}
+
+template <class T, class Activation, class Acc>
+void Population<T, Activation, Acc>::evolve(const function<double(EvolutionGNN<T, Activation, Acc>&)>& fitnessFunction, int generations) {
+	for (int i = 0; i < generations; ++i) {
+		evaluate(fitnessFunction);
+		reproduce();
+	}
+}
+
+template <class T, class Activation, class Acc>
+void Population<T, Activation, Acc>::reproduce() {
+	int size = genomes.size();
+	if (size == 0)return;
+
+	//Rank genomes by fitness
+	vector<int> order(size);
+	for (int i = 0; i < size; ++i)
+		order[i] = i;
+	stable_sort(order.begin(), order.end(), [&](int a, int b) { return fitness[a] > fitness[b]; });
+
+	//Parents are only read from now on
+	workerPool->parallelFor(size, [&](int index, int) {
+		genomes[index]->decompile();
+	});
+
+	int elites = eliteCount < size ? eliteCount : size;
+	vector<unique_ptr<EvolutionGNN<T, Activation, Acc>>> next(size);
+	vector<double> nextFitness(size, 0.0);
+
+	//Every child gets its stream before any task starts
+	vector<EvoRandom> streams(size - elites);
+	for (int i = 0; i < streams.size(); ++i)
+		streams[i] = random.split();
+
+	//Breed children
+	workerPool->parallelFor(size - elites, [&](int index, int) {
+		unique_ptr<EvolutionGNN<T, Activation, Acc>> child = make_unique<EvolutionGNN<T, Activation, Acc>>(workerPool->getWorkerCount());
+		child->setRandom(streams[index]);
+
+		EvolutionGNN<T, Activation, Acc>& parentA = *genomes[selectParent(child->getRandom())];
+		EvolutionGNN<T, Activation, Acc>& parentB = *genomes[selectParent(child->getRandom())];
+
+		child->inherit(parentA, parentB, AConRate, BConRate, inheritMemory);
+		child->mutate(newConRate, deleteConRate, newNodeRate, repeatRate, activationRate);
+		child->setWorkerPool(workerPool);
+		next[elites + index] = move(child);
+	});
+
+	//Elites move to the next generation once no child reads them anymore
+	for (int i = 0; i < elites; ++i) {
+		next[i] = move(genomes[order[i]]);
+		nextFitness[i] = fitness[order[i]];
+	}
+
+	genomes = move(next);
+	fitness = move(nextFitness);
+	++generation;
+}
+
+template <class T, class Activation, class Acc>
+void Population<T, Activation, Acc>::evaluate(const function<double(EvolutionGNN<T, Activation, Acc>&)>& fitnessFunction) {
+	fitness.assign(genomes.size(), 0.0);
+
+	//Genomes that would run multi-threaded are left for later, as the pool is busy
+	vector<int> small, large;
+	for (int i = 0; i < genomes.size(); ++i)
+		if (genomes[i]->determineNumberOfThread() > 1)large.push_back(i);
+		else
+			small.push_back(i);
+
+	workerPool->parallelFor(small.size(), [&](int index, int) {
+		fitness[small[index]] = fitnessFunction(*genomes[small[index]]);
+	});
+
+	//Large genomes split their own steps over the pool
+	for (int i = 0; i < large.size(); ++i)
+		fitness[large[i]] = fitnessFunction(*genomes[large[i]]);
+}
+
+template <class T, class Activation, class Acc>
+int Population<T, Activation, Acc>::selectParent(EvoRandom& random) {
+	int best = random.nextInt(genomes.size());
+	for (int i = 1; i < tournamentSize; ++i) {
+		int challenger = random.nextInt(genomes.size());
+		if (fitness[challenger] > fitness[best])best = challenger;
+	}
+	return best;
+}
+
+template <class T, class Activation, class Acc>
+void Population<T, Activation, Acc>::setMutation(double newConRate, double deleteConRate, double newNodeRate, double repeatRate, double activationRate) {
+	this->newConRate = newConRate;
+	this->deleteConRate = deleteConRate;
+	this->newNodeRate = newNodeRate;
+	this->repeatRate = repeatRate;
+	this->activationRate = activationRate;
+}
+
+template <class T, class Activation, class Acc>
+void Population<T, Activation, Acc>::setCrossover(double AConRate, double BConRate, bool inheritMemory) {
+	this->AConRate = AConRate;
+	this->BConRate = BConRate;
+	this->inheritMemory = inheritMemory;
+}
+
+template <class T, class Activation, class Acc>
+void Population<T, Activation, Acc>::setSelection(int eliteCount, int tournamentSize) {
+	this->eliteCount = eliteCount < 0 ? 0 : eliteCount;
+	this->tournamentSize = tournamentSize < 1 ? 1 : tournamentSize;
+}
+
+template <class T, class Activation, class Acc>
+void Population<T, Activation, Acc>::seed(unsigned long long seed) {
+	random.seed(seed);
+	for (int i = 0; i < genomes.size(); ++i)
+		genomes[i]->setRandom(random.split());
+}
+
+template <class T, class Activation, class Acc>
+shared_ptr<WorkerPool> Population<T, Activation, Acc>::getWorkerPool() {
+	return workerPool;
+}
+
+template <class T, class Activation, class Acc>
+int Population<T, Activation, Acc>::getGeneration() {
+	return generation;
+}
+
+template <class T, class Activation, class Acc>
+EvolutionGNN<T, Activation, Acc>& Population<T, Activation, Acc>::getBest() {
+	int best = 0;
+	for (int i = 1; i < fitness.size(); ++i)
+		if (fitness[i] > fitness[best])best = i;
+	return *genomes[best];
+}
+
+template <class T, class Activation, class Acc>
+double Population<T, Activation, Acc>::getFitness(int index) {
+	return fitness[index];
+}
+
+template <class T, class Activation, class Acc>
+EvolutionGNN<T, Activation, Acc>& Population<T, Activation, Acc>::getGenome(int index) {
+	return *genomes[index];
+}
+
+template <class T, class Activation, class Acc>
+int Population<T, Activation, Acc>::getSize() {
+	return genomes.size();
+}
+
+template <class T, class Activation, class Acc>
+void Population<T, Activation, Acc>::initialize(int size, int inputCount, int outputCount, int threadCount) {
+	if (threadCount < 0)
+		threadCount = thread::hardware_concurrency();
+	if (threadCount <= 0)
+		threadCount = 1;
+	if (!workerPool || workerPool->getWorkerCount() != threadCount)
+		workerPool = make_shared<WorkerPool>(threadCount);
+
+	genomes.clear();
+	for (int i = 0; i < size; ++i) {
+		genomes.push_back(make_unique<EvolutionGNN<T, Activation, Acc>>(inputCount, outputCount, threadCount));
+		genomes.back()->setWorkerPool(workerPool);
+		genomes.back()->setRandom(random.split());
+	}
+	fitness.assign(size, 0.0);
+	generation = 0;
+}
+
+template <class T, class Activation, class Acc>
+Population<T, Activation, Acc>::Population(int size, int inputCount, int outputCount, int threadCount) {
+	setSelection();
+	setCrossover();
+	setMutation();
+	random.seed(rand());
+	initialize(size, inputCount, outputCount, threadCount);
+}
+
+template <class T, class Activation, class Acc>
+Population<T, Activation, Acc>::Population(int threadCount) {
+	setSelection();
+	setCrossover();
+	setMutation();
+	random.seed(rand());
+	initialize(0, 0, 0, threadCount);
+}
+
+template <class T, class Activation, class Acc>
+void EvolutionGNN<T, Activation, Acc>::saveDOT(string filename) {
+	fstream file;
+	file.open(filename, ios::out);
+	file << getDOT();
+	file.close();
+}
+
+template <class T, class Activation, class Acc>
+string EvolutionGNN<T, Activation, Acc>::getDOT() {
+	string dot;
+
+	//Syntex
+	dot += "digraph Evolutional_Graph_Neural_Network {\n";
+	dot += "\trankdir=TB;\n";
+	dot += "\tnode [shape = circle];\n";
+
+	//All input nodes
+	dot += "\tsubgraph cluster_0 {\n";
+	dot += "\t\tlabel=\"Input Nodes\";\n";
+	for (int i = 0; i < inputNodes.size(); ++i)
+		dot += "\t\t" + to_string(i) + "; ";
+	dot += "\n\t}\n";
+
+	//All output nodes
+	dot += '\n';
+	dot += "\tsubgraph cluster_1 {\n";
+	dot += "\t\tlabel=\"Output Nodes\";\n";
+	int s = inputNodes.size();
+	for (int i = 0; i < outputNodes.size(); ++i)
+		dot += "\t\t" + to_string(i + s) + "; ";
+	dot += "\n\t}\n\n";
+
+	////Uncomment to show disconnected nodes
+	////All hidden nodes
+	//dot += '\t';
+	//s = inputNodes.size() + outputNodes.size();
+	//for(int i = 0; i < graphNodes.size(); ++i)
+	//	dot += to_string(i + s) + "; ";
+	//dot += "\n\n";
+
+
+	//All connections (edges)
+	for (ConnectionHandle i : con)
+		dot += '\t' + connectionPool[i].getDOT() + '\n';
+
+	//Syntex
+	dot += "}\n";
+
+	return dot;
+}
+
+template <class T, class Activation, class Acc>
+void EvolutionGNN<T, Activation, Acc>::mutate(double newConRate, double deleteConRate, double newNodeRate, double repeatRate, double activationRate) {
+	do {
+		//Create a new connection
+		if (random.nextDouble() < newConRate)
+			addRandomConnection();
+
+		//Delete a connection
+		if (random.nextDouble() < deleteConRate)
+			if (con.size() > 0)
+				removeConnection(random.nextInt(con.size()));
+
+		//Create a new node
+		if (random.nextDouble() < newNodeRate)
+			addNodes();
+
+		//Change activation function of a node
+		if (activationRate > 0.0 && random.nextDouble() < activationRate)
+			setActivation(random.nextInt(nodeCount - inputNodes.size()) + inputNodes.size(), random.nextInt(ACTIVATION_COUNT));
+
+	} while (random.nextDouble() < repeatRate);	//Mutate once more
+}
+
+template <class T, class Activation, class Acc>
+void EvolutionGNN<T, Activation, Acc>::inherit(EvolutionGNN<T, Activation, Acc>& parentA, EvolutionGNN<T, Activation, Acc>& parentB, double AConRate, double BConRate, bool inheritMemory) {
+
+	//Check required number of nodes
+	int inNodeCount = parentA.inputNodes.size();
+	int outNodeCount = parentA.outputNodes.size();
+	int hiddenNodeCount = parentA.graphNodes.size();
+	if (parentB.inputNodes.size() > inNodeCount)inNodeCount = parentB.inputNodes.size();
+	if (parentB.outputNodes.size() > outNodeCount)outNodeCount = parentB.outputNodes.size();
+	if (parentB.graphNodes.size() > hiddenNodeCount)hiddenNodeCount = parentB.graphNodes.size();
+
+	//Create all nodes
+	initialize(inNodeCount, outNodeCount, threadCount);
+	addNodes(hiddenNodeCount);
+
+	//Make sure parents' Connections hold their latest states
+	parentA.syncCompiled();
+	parentB.syncCompiled();
+
+	//Selectively add connections from parents
+	//Note that if we also add buffer related info(values, states) to the child,
+	//"memory" will be passed to the child
+	for (ConnectionHandle h : parentA.con)
+		if (random.nextDouble() < AConRate) {
+			Connection<T>& i = parentA.connectionPool[h];
+			if (inheritMemory)
+				addConnection(i.getInNodeId(), i.getOutNodeId(), i.getWeight(), i.getABuffer(), i.getBBuffer(), i.getBufferState());
+			else
+				addConnection(i.getInNodeId(), i.getOutNodeId(), i.getWeight());
+		}
+
+	for (ConnectionHandle h : parentB.con)
+		if (random.nextDouble() < BConRate) {
+			Connection<T>& i = parentB.connectionPool[h];
+			if (inheritMemory)
+				addConnection(i.getInNodeId(), i.getOutNodeId(), i.getWeight(), i.getABuffer(), i.getBBuffer(), i.getBufferState());
+			else
+				addConnection(i.getInNodeId(), i.getOutNodeId(), i.getWeight());
+		}
+
+	//Activation functions are taken from parentA, or parentB where parentA uses the default
+	for (int i = 0; i < nodeCount; ++i) {
+		int activation = parentA.getActivation(i);
+		if (activation == ACTIVATION_DEFAULT)activation = parentB.getActivation(i);
+		if (activation != ACTIVATION_DEFAULT)setActivation(i, activation);
+	}
+}
+
+template <class T, class Activation, class Acc>
+bool EvolutionGNN<T, Activation, Acc>::load(string path) {
+
+	fstream in;
+	in.open(path, ios::in | ios::binary);
+
+	//Check if file open succeed
+	if (!in.is_open())return false;
+
+	char str[32] = { 0 };
+	in.read(str, 11);
+
+	//Files of version 2 start with a binary header
+	if (in.gcount() >= (streamsize)sizeof(MODEL_MAGIC) && !memcmp(str, MODEL_MAGIC, sizeof(MODEL_MAGIC))) {
+		in.close();
+		return loadModel(path);
+	}
+
+	//cout << "Read: " << str << endl;
+	//Check if keyword correct
+	if (strcmp(str, "InputNodes=")) {
+		//Error
+		in.close();
+		//cout << "Wrong keyword." << endl;
+		return false;
+	}
+
+	//Get InputNodes
+	int inputNodes;
+	in >> inputNodes;
+
+	//cout << "InputNodes=" << inputNodes << endl;
+	if (inputNodes < 0) {
+		//Error
+		in.close();
+		//cout << "Wrong inputNodes." << endl;
+		return false;
+	}
+
+
+	in.read(str, 13);
+	//cout << "Read: " << str << endl;//Check if keyword correct
+	if (strcmp(str, "\nHiddenNodes=")) {
+		//Error
+		in.close();
+		//cout << "Wrong keyword." << endl;
+		return false;
+	}
+
+	//Get HiddenNodes
+	int hiddenNodes;
+	in >> hiddenNodes;
+
+	//cout << "HiddenNodes=" << hiddenNodes << endl;
+	if (hiddenNodes < 0) {
+		//Error
+		in.close();
+		//cout << "Wrong hiddenNodes." << endl;
+		return false;
+	}
+
+
+	in.read(str, 13);
+	//cout << "Read: " << str << endl;//Check if keyword correct
+	if (strcmp(str, "\nOutputNodes=")) {
+		//Error
+		in.close();
+		//cout << "Wrong keyword." << endl;
+		return false;
+	}
+
+	//Get outputNodes
+	int outputNodes;
+	in >> outputNodes;
+
+	//cout << "OutputNodes=" << outputNodes << endl;
+	if (outputNodes < 0) {
+		//Error
+		in.close();
+		//cout << "Wrong outputNodes." << endl;
+		return false;
+	}
+
+
+	in.read(str, 13);
+	//cout << "Read: " << str << endl;//Check if keyword correct
+	if (strcmp(str, "\nConnections=")) {
+		//Error
+		in.close();
+		//cout << "Wrong keyword." << endl;
+		return false;
+	}
+
+	//Get HiddenNodes
+	int connections;
+	in >> connections;
+
+	//cout << "Connections=" << connections << endl;
+	if (connections < 0) {
+		//Error
+		in.close();
+		//cout << "Wrong connections." << endl;
+		return false;
+	}
+
+	//Read extra '\n'
+	in.read(str, 1);
+
+	//Prepare for initialization, keeping the number of threads
+	int threads = threadCount;
+	cleanUp();
+
+	//Initialize with given inputNodes and outputNodes
+	initialize(inputNodes, outputNodes, threads);
+
+	//Add all nodes
+	addNodes(hiddenNodes);
+
+	//Create all connections at once, then fill them from large chunks of records
+	//Each record is inNodeId, outNodeId, weight, ABuffer, BBuffer, useABuffer, packed
+	const int recordSize = 2 * sizeof(int) + 3 * sizeof(T) + sizeof(bool);
+	const int chunkSize = max(1, LOAD_CHUNK_BYTES / recordSize);
+	ConnectionHandle first = connectionPool.allocate(connections);
+	vector<char> chunk((size_t)min(connections, chunkSize) * recordSize);
+	for (int done = 0; done < connections;) {
+		int count = min(connections - done, chunkSize);
+		in.read(chunk.data(), (size_t)count * recordSize);
+		if (in.gcount() != (streamsize)count * recordSize) {
+			//cout << "File ends within connections." << endl;
+			cleanUp();
+			in.close();
+			return false;
+		}
+
+		//Records are decoded in parallel
+		forBlocks(count, [&](int start, int end) {
+			int inNode, outNode;
+			T weight, ABuffer, BBuffer;
+			for (int i = start; i < end; ++i) {
+				const char* record = chunk.data() + (size_t)i * recordSize;
+				memcpy(&inNode, record, sizeof(int));
+				memcpy(&outNode, record + sizeof(int), sizeof(int));
+				memcpy(&weight, record + 2 * sizeof(int), sizeof(T));
+				memcpy(&ABuffer, record + 2 * sizeof(int) + sizeof(T), sizeof(T));
+				memcpy(&BBuffer, record + 2 * sizeof(int) + 2 * sizeof(T), sizeof(T));
+				bool useABuffer = record[2 * sizeof(int) + 3 * sizeof(T)] != 0;
+				connectionPool[first + done + i] = Connection<T>(inNode, outNode, weight, ABuffer, BBuffer, useABuffer);
+			}
+		});
+		done += count;
+	}
+
+	if (!linkConnections(first, connections)) {
+		cleanUp();
+		in.close();
+		return false;
+	}
+
+	//Activation functions are optional
+	memset(str, 0, sizeof(str));
+	in.read(str, 12);
+	if (in.gcount() == 12 && !strcmp(str, "Activations=")) {
+		int count;
+		in >> count;
+		in.read(str, 1);
+
+		vector<unsigned char> ids(count > 0 ? count : 0);
+		in.read(reinterpret_cast<char*>(ids.data()), ids.size());
+		for (int i = 0; i < ids.size(); ++i)
+			if (ids[i] != ACTIVATION_DEFAULT && ids[i] < ACTIVATION_COUNT)
+				setActivation(i, ids[i]);
+	}
+
+	in.close();
+
+	return true;
+}
+
+template <class T, class Activation, class Acc>
+void EvolutionGNN<T, Activation, Acc>::sketch(vector<unsigned int>& bins, int count) {
+	bins.assign(count, UINT_MAX);
+	for (ConnectionHandle h : con) {
+		Connection<T>& c = connectionPool[h];
+
+		//splitmix64 finalizer, low bits pick the bin and high bits are compared
+		unsigned long long x = (unsigned long long)c.getInNodeId() << 32 | (unsigned int)c.getOutNodeId();
+		x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+		x ^= x >> 31;
+
+		unsigned int& bin = bins[x % count];
+		bin = min(bin, (unsigned int)(x >> 32));
+	}
+}
+
+template <class T, class Activation, class Acc>
+bool EvolutionGNN<T, Activation, Acc>::decode(const char* data, size_t size, EvolutionGNN<T, Activation, Acc>* base) {
+	int counts[5];
+	if (size < sizeof(counts))return false;
+	memcpy(counts, data, sizeof(counts));
+	size_t offset = sizeof(counts);
+
+	int inputs = counts[0], outputs = counts[1], hidden = counts[2], connections = counts[3], added = counts[4];
+	if (inputs < 0 || outputs < 0 || hidden < 0 || connections < 0 || added < 0 || added > connections)return false;
+	if (added < connections && !base)return false;
+
+	//A run of the codec covers at most 130 bytes, so larger counts can not be valid
+	if ((double)inputs + outputs + hidden + connections > (double)size * 130)return false;
+	int nodes = inputs + outputs + hidden;
+
+	vector<unsigned char> ids(nodes);
+	vector<T> values(inputs + outputs);
+	vector<unsigned int> refs(connections - added);
+	vector<int> inIds(added), outIds(added);
+	vector<T> weights(added), changes(connections - added), ABuffers(connections), BBuffers(connections);
+	vector<char> states(connections);
+	vector<unsigned char> matched((connections + 7) / 8);
+	if (!ArchiveCodec::unpack(data, size, offset, ids.data(), ids.size(), 1))return false;
+	if (!ArchiveCodec::unpack(data, size, offset, values.data(), values.size(), sizeof(T)))return false;
+	if (!ArchiveCodec::unpack(data, size, offset, matched.data(), matched.size(), 1))return false;
+	if (!ArchiveCodec::unpack(data, size, offset, refs.data(), refs.size(), sizeof(int)))return false;
+	if (!ArchiveCodec::unpack(data, size, offset, inIds.data(), added, sizeof(int)))return false;
+	if (!ArchiveCodec::unpack(data, size, offset, outIds.data(), added, sizeof(int)))return false;
+	if (!ArchiveCodec::unpack(data, size, offset, weights.data(), added, sizeof(T)))return false;
+	if (!ArchiveCodec::unpack(data, size, offset, changes.data(), changes.size(), sizeof(T)))return false;
+	if (!ArchiveCodec::unpack(data, size, offset, ABuffers.data(), connections, sizeof(T)))return false;
+	if (!ArchiveCodec::unpack(data, size, offset, BBuffers.data(), connections, sizeof(T)))return false;
+	if (!ArchiveCodec::unpack(data, size, offset, states.data(), connections, 1))return false;
+
+	//Order of node lists, removed nodes and random stream, missing in older records
+	bool ordered = offset < size;
+	vector<unsigned int> inOrder, outOrder;
+	vector<int> free;
+	unsigned long long state[4];
+	if (ordered) {
+		int freeCount;
+		if (size - offset < sizeof(int))return false;
+		memcpy(&freeCount, data + offset, sizeof(int));
+		offset += sizeof(int);
+		if (freeCount < 0 || freeCount > hidden)return false;
+
+		inOrder.resize(connections);
+		outOrder.resize(connections);
+		free.resize(freeCount);
+		if (!ArchiveCodec::unpack(data, size, offset, inOrder.data(), connections, sizeof(int)))return false;
+		if (!ArchiveCodec::unpack(data, size, offset, outOrder.data(), connections, sizeof(int)))return false;
+		if (!ArchiveCodec::unpack(data, size, offset, free.data(), freeCount, sizeof(int)))return false;
+		if (!ArchiveCodec::unpack(data, size, offset, state, 4, sizeof(unsigned long long)))return false;
+		for (int id : free)
+			if (id < inputs + outputs || id >= nodes)return false;
+	}
+
+	//Prepare for initialization, keeping the number of threads
+	int threads = threadCount;
+	cleanUp();
+	initialize(inputs, outputs, threads);
+	addNodes(hidden);
+
+	ConnectionHandle first = connectionPool.allocate(connections);
+	vector<int> lastFrom(nodes, -1);
+	int previous = 0, next = 0, change = 0;
+	for (int k = 0; k < connections; ++k) {
+		int inNode, outNode;
+		T weight;
+		bool state = states[k] != 0;
+		if (matched[k / 8] >> (k % 8) & 1) {
+			//Matched connections store their differences to the one in base
+			if (change == refs.size()) {
+				cleanUp();
+				return false;
+			}
+			long long index = previous + (long long)(int)(refs[change] >> 1 ^ (0u - (refs[change] & 1)));
+			if (index < 0 || index >= base->con.size()) {
+				cleanUp();
+				return false;
+			}
+			previous = index + 1;
+			Connection<T>& c = base->connectionPool[base->con[index]];
+			inNode = c.getInNodeId();
+			outNode = c.getOutNodeId();
+			weight = ArchiveCodec::xorBits(changes[change], c.getWeight());
+			state = state != c.getBufferState();
+			++change;
+		}
+		else {
+			if (next == added) {
+				cleanUp();
+				return false;
+			}
+			inNode = inIds[next];
+			outNode = outIds[next];
+			weight = weights[next];
+			++next;
+		}
+		if (inNode < 0 || inNode >= nodes || outNode < 0 || outNode >= nodes) {
+			cleanUp();
+			return false;
+		}
+
+		//Buffers are stored as the difference to the last connection from the same node
+		T ABuffer = ABuffers[k], BBuffer = BBuffers[k];
+		if (lastFrom[inNode] >= 0) {
+			Connection<T>& last = connectionPool[first + lastFrom[inNode]];
+			ABuffer = ArchiveCodec::xorBits(ABuffer, last.getABuffer());
+			BBuffer = ArchiveCodec::xorBits(BBuffer, last.getBBuffer());
+		}
+		lastFrom[inNode] = k;
+
+		connectionPool[first + k] = Connection<T>(inNode, outNode, weight, ABuffer, BBuffer, state);
+	}
+
+	if (!linkConnections(first, connections)) {
+		cleanUp();
+		return false;
+	}
+
+	if (ordered) {
+		//linkConnections() listed connections in the order of con, move them to their saved places
+		vector<int> inRank(nodes, 0), outRank(nodes, 0);
+		for (int k = 0; k < connections; ++k) {
+			Connection<T>& c = connectionPool[first + k];
+			long long in = inRank[c.getOutNodeId()]++ + (long long)(int)(inOrder[k] >> 1 ^ (0u - (inOrder[k] & 1)));
+			long long out = outRank[c.getInNodeId()]++ + (long long)(int)(outOrder[k] >> 1 ^ (0u - (outOrder[k] & 1)));
+			if (in < 0 || in >= getNode(c.getOutNodeId()).getInCon().size() || out < 0 || out >= getNode(c.getInNodeId()).getOutCon().size()) {
+				cleanUp();
+				return false;
+			}
+			c.setInConIndex(in);
+			c.setOutConIndex(out);
+		}
+		for (int k = 0; k < connections; ++k) {
+			Connection<T>& c = connectionPool[first + k];
+			getNode(c.getOutNodeId()).getInCon()[c.getInConIndex()] = first + k;
+			getNode(c.getInNodeId()).getOutCon()[c.getOutConIndex()] = first + k;
+		}
+
+		//Two connections placed at the same position leave another one missing
+		for (int k = 0; k < connections; ++k) {
+			Connection<T>& c = connectionPool[first + k];
+			if (getNode(c.getOutNodeId()).getInCon()[c.getInConIndex()] != first + k || getNode(c.getInNodeId()).getOutCon()[c.getOutConIndex()] != first + k) {
+				cleanUp();
+				return false;
+			}
+		}
+
+		freeNodes = free;
+		random.setState(state);
+	}
+
+	for (int i = 0; i < inputs; ++i)
+		inputNodes[i] = values[i];
+	for (int i = 0; i < outputs; ++i)
+		outputNodes[i].set(values[inputs + i]);
+
+	for (int i = 0; i < ids.size(); ++i)
+		if (ids[i] != ACTIVATION_DEFAULT && ids[i] < ACTIVATION_COUNT)
+			setActivation(i, ids[i]);
+
+	return true;
+}
+
+template <class T, class Activation, class Acc>
+void EvolutionGNN<T, Activation, Acc>::encode(vector<char>& out, EvolutionGNN<T, Activation, Acc>* base) {
+	//Make sure Connections hold their latest states
+	syncCompiled();
+
+	auto key = [](Connection<T>& c) {
+		return (long long)c.getInNodeId() << 32 | (unsigned int)c.getOutNodeId();
+	};
+
+	//Match each connection to the first unused connection of base between the same nodes,
+	//or to the last one when all are used, as inherit() may copy a pair from both parents
+	vector<int> matches(con.size(), -1);
+	if (base) {
+		unordered_map<long long, int> unused;
+		vector<int> nextSame(base->con.size(), -1);
+		for (int j = (int)base->con.size() - 1; j >= 0; --j) {
+			long long k = key(base->connectionPool[base->con[j]]);
+			auto it = unused.find(k);
+			nextSame[j] = it == unused.end() ? -1 : it->second;
+			unused[k] = j;
+		}
+		for (int i = 0; i < con.size(); ++i) {
+			auto it = unused.find(key(connectionPool[con[i]]));
+			if (it == unused.end())continue;
+			matches[i] = it->second;
+			if (nextSame[it->second] >= 0)it->second = nextSame[it->second];
+		}
+	}
+
+	vector<unsigned char> ids(nodeCount, ACTIVATION_DEFAULT);
+	for (int i = 0; i < activations.size() && i < nodeCount; ++i)
+		ids[i] = activations[i];
+
+	vector<T> values;
+	for (int i = 0; i < inputNodes.size(); ++i)
+		values.push_back(inputNodes[i].get());
+	for (int i = 0; i < outputNodes.size(); ++i)
+		values.push_back(outputNodes[i].get());
+
+	//Matched connections are stored as their distance to the connection after the
+	//previous match, zigzag encoded so runs copied from base are stored as zeros,
+	//and the XOR of weight and buffer state with the matched one
+	//Other connections are stored in full, in separate streams so they do not
+	//break the runs of zeros left by unchanged ones
+	//Every node writes the same value to all of its out-going connections, so buffers
+	//are stored as the XOR with the last connection from the same node
+	vector<unsigned char> matched((con.size() + 7) / 8, 0);
+	vector<unsigned int> refs;
+	vector<int> inIds, outIds;
+	vector<T> weights, changes, ABuffers(con.size()), BBuffers(con.size());
+	vector<char> states(con.size());
+	vector<int> lastFrom(nodeCount, -1);
+	int previous = 0;
+	for (int i = 0; i < con.size(); ++i) {
+		Connection<T>& c = connectionPool[con[i]];
+		states[i] = c.getBufferState();
+		if (matches[i] < 0) {
+			inIds.push_back(c.getInNodeId());
+			outIds.push_back(c.getOutNodeId());
+			weights.push_back(c.getWeight());
+		}
+		else {
+			Connection<T>& b = base->connectionPool[base->con[matches[i]]];
+			matched[i / 8] |= 1 << (i % 8);
+			int step = matches[i] - previous;
+			refs.push_back((unsigned int)step << 1 ^ (unsigned int)(step >> 31));
+			previous = matches[i] + 1;
+			changes.push_back(ArchiveCodec::xorBits(c.getWeight(), b.getWeight()));
+			states[i] = states[i] != b.getBufferState();
+		}
+
+		ABuffers[i] = c.getABuffer();
+		BBuffers[i] = c.getBBuffer();
+		int& last = lastFrom[c.getInNodeId()];
+		if (last >= 0) {
+			ABuffers[i] = ArchiveCodec::xorBits(ABuffers[i], connectionPool[con[last]].getABuffer());
+			BBuffers[i] = ArchiveCodec::xorBits(BBuffers[i], connectionPool[con[last]].getBBuffer());
+		}
+		last = i;
+	}
+
+	int counts[5] = { (int)inputNodes.size(), (int)outputNodes.size(), (int)graphNodes.size(), (int)con.size(), (int)inIds.size() };
+	out.insert(out.end(), reinterpret_cast<char*>(counts), reinterpret_cast<char*>(counts) + sizeof(counts));
+
+	ArchiveCodec::pack(out, ids.data(), ids.size(), 1);
+	ArchiveCodec::pack(out, values.data(), values.size(), sizeof(T));
+	ArchiveCodec::pack(out, matched.data(), matched.size(), 1);
+	ArchiveCodec::pack(out, refs.data(), refs.size(), sizeof(int));
+	ArchiveCodec::pack(out, inIds.data(), inIds.size(), sizeof(int));
+	ArchiveCodec::pack(out, outIds.data(), outIds.size(), sizeof(int));
+	ArchiveCodec::pack(out, weights.data(), weights.size(), sizeof(T));
+	ArchiveCodec::pack(out, changes.data(), changes.size(), sizeof(T));
+	ArchiveCodec::pack(out, ABuffers.data(), ABuffers.size(), sizeof(T));
+	ArchiveCodec::pack(out, BBuffers.data(), BBuffers.size(), sizeof(T));
+	ArchiveCodec::pack(out, states.data(), states.size(), 1);
+
+	//Node lists keep the order connections were added in, until a removal swaps one in,
+	//so positions are stored as the difference to that order, zigzag encoded
+	vector<unsigned int> inOrder(con.size()), outOrder(con.size());
+	vector<int> inRank(nodeCount, 0), outRank(nodeCount, 0);
+	for (int i = 0; i < con.size(); ++i) {
+		Connection<T>& c = connectionPool[con[i]];
+		int in = c.getInConIndex() - inRank[c.getOutNodeId()]++;
+		int out = c.getOutConIndex() - outRank[c.getInNodeId()]++;
+		inOrder[i] = (unsigned int)in << 1 ^ (unsigned int)(in >> 31);
+		outOrder[i] = (unsigned int)out << 1 ^ (unsigned int)(out >> 31);
+	}
+
+	unsigned long long state[4];
+	random.getState(state);
+	int freeCount = freeNodes.size();
+	out.insert(out.end(), reinterpret_cast<char*>(&freeCount), reinterpret_cast<char*>(&freeCount) + sizeof(int));
+	ArchiveCodec::pack(out, inOrder.data(), inOrder.size(), sizeof(int));
+	ArchiveCodec::pack(out, outOrder.data(), outOrder.size(), sizeof(int));
+	ArchiveCodec::pack(out, freeNodes.data(), freeNodes.size(), sizeof(int));
+	ArchiveCodec::pack(out, state, 4, sizeof(unsigned long long));
+}
+
+template <class T, class Activation, class Acc>
+bool EvolutionGNN<T, Activation, Acc>::linkConnections(ConnectionHandle first, int count, const int* indices) {
+	invalidateCompiled();
+	partition.clear();
+	liveValid = false;
+	settleValid = false;
+	invalidateQuantized();
+
+	//Hidden nodes are created up to the largest id
+	int largest = -1;
+	for (int k = 0; k < count; ++k) {
+		Connection<T>& c = connectionPool[first + k];
+		if (c.getInNodeId() < 0 || c.getOutNodeId() < 0)return false;
+		largest = max(largest, max(c.getInNodeId(), c.getOutNodeId()));
+	}
+	if (largest >= 0)getNode(largest);
+
+	//Count connections of each node, and make room for them at the end of its lists
+	vector<int> inCursor(nodeCount, 0), outCursor(nodeCount, 0);
+	for (int k = 0; k < count; ++k) {
+		Connection<T>& c = connectionPool[first + k];
+		++inCursor[c.getOutNodeId()];
+		++outCursor[c.getInNodeId()];
+	}
+	for (int id = 0; id < nodeCount; ++id) {
+		GraphNode<T>& node = getNode(id);
+		int in = node.getInCon().size();
+		int out = node.getOutCon().size();
+		node.getInCon().resize(in + inCursor[id]);
+		node.getOutCon().resize(out + outCursor[id]);
+		inCursor[id] = in;
+		outCursor[id] = out;
+	}
+
+	//Place every connection in the lists of its nodes
+	for (int k = 0; k < count; ++k) {
+		ConnectionHandle handle = first + k;
+		Connection<T>& c = connectionPool[handle];
+
+		int in = inCursor[c.getOutNodeId()]++;
+		getNode(c.getOutNodeId()).getInCon()[in] = handle;
+		c.setInConIndex(in);
+
+		int out = outCursor[c.getInNodeId()]++;
+		getNode(c.getInNodeId()).getOutCon()[out] = handle;
+		c.setOutConIndex(out);
+	}
+
+	int base = con.size();
+	con.resize(base + count);
+	for (int k = 0; k < count; ++k) {
+		int index = base + (indices ? indices[k] : k);
+		con[index] = first + k;
+		connectionPool[first + k].setIndex(index);
+	}
+
+	return true;
+}
+
+template <class T, class Activation, class Acc>
+template <class Work>
+void EvolutionGNN<T, Activation, Acc>::forBlocks(int count, const Work& work) {
+	//Same amount of work per thread as determineNumberOfThread()
+	int threads = min(threadCount, count / 100000);
+	if (threads <= 1) {
+		work(0, count);
+		return;
+	}
+
+	int blocks = (count + LOAD_BLOCK - 1) / LOAD_BLOCK;
+	prepareWorkerPool().parallelFor(blocks, [&](int block, int) {
+		work(block * LOAD_BLOCK, min(count, (block + 1) * LOAD_BLOCK));
+	});
+}
+
+template <class T, class Activation, class Acc>
+bool EvolutionGNN<T, Activation, Acc>::loadModel(string path) {
+	MappedFile file;
+	if (!file.open(path) || file.getSize() < sizeof(ModelHeader))return false;
+
+	const char* data = file.getData();
+	ModelHeader header;
+	memcpy(&header, data, sizeof(ModelHeader));
+	if (!header.template check<T, Acc>(data, file.getSize()))return false;
+
+	const int* rowOffsets = reinterpret_cast<const int*>(data + header.offsets[SECTION_ROW_OFFSETS]);
+	const int* rowEnds = reinterpret_cast<const int*>(data + header.offsets[SECTION_ROW_ENDS]);
+	const int* sources = reinterpret_cast<const int*>(data + header.offsets[SECTION_SOURCES]);
+	const T* weights = reinterpret_cast<const T*>(data + header.offsets[SECTION_WEIGHTS]);
+	const T* read = reinterpret_cast<const T*>(data + header.offsets[SECTION_READ]);
+	const T* write = reinterpret_cast<const T*>(data + header.offsets[SECTION_WRITE]);
+	const char* states = data + header.offsets[SECTION_STATES];
+	const int* indices = reinterpret_cast<const int*>(data + header.offsets[SECTION_INDICES]);
+	const int* order = reinterpret_cast<const int*>(data + header.offsets[SECTION_ORDER]);
+	vector<Acc> values = header.template getValues<T, Acc>(data);
+	const unsigned char* ids = reinterpret_cast<const unsigned char*>(data + header.offsets[SECTION_ACTIVATIONS]);
+	int nodes = header.getNodeSize();
+
+	//Prepare for initialization, keeping the number of threads
+	int threads = threadCount;
+	cleanUp();
+	initialize(header.inputCount, header.outputCount, threads);
+	addNodes(header.hiddenCount);
+
+	//Live connections of each row get consecutive handles,
+	//so every inCon gets back its saved order
+	vector<int> firstLive(nodes + 1, 0);
+	for (int p = 0; p < nodes; ++p)
+		firstLive[p + 1] = firstLive[p] + rowEnds[p] - rowOffsets[p];
+
+	//Create all connections at once, and fill them from slots in parallel
+	//Buffers are stored relative to the next run, like CompiledGraph::compile()
+	int connections = header.connectionCount;
+	ConnectionHandle first = connectionPool.allocate(connections);
+	vector<int> placed(connections);
+	forBlocks(header.slotCount, [&](int start, int end) {
+		int p = upper_bound(rowOffsets, rowOffsets + nodes + 1, start) - rowOffsets - 1;
+		for (int i = start; i < end; ++i) {
+			while (i >= rowOffsets[p + 1])++p;
+			if (i >= rowEnds[p])continue;
+
+			int k = firstLive[p] + i - rowOffsets[p];
+			bool state = states[i];
+			connectionPool[first + k] = Connection<T>(order[sources[i]], order[p], weights[i], state ? write[i] : read[i], state ? read[i] : write[i], state);
+			placed[k] = indices[i];
+		}
+	});
+
+	//Connections go back to their saved places in con
+	if (!linkConnections(first, connections, placed.data())) {
+		cleanUp();
+		return false;
+	}
+
+	//Inputs and last outputs
+	for (int i = 0; i < inputNodes.size(); ++i)
+		inputNodes[i] = T(values[i]);
+	for (int i = 0; i < outputNodes.size(); ++i)
+		outputNodes[i].set(T(values[inputNodes.size() + i]));
+
+	for (int i = 0; i < nodes; ++i)
+		if (ids[i] != ACTIVATION_DEFAULT && ids[i] < ACTIVATION_COUNT)
+			setActivation(i, ids[i]);
+
+	return true;
+}
+
+template <class T, class Activation, class Acc>
+void EvolutionGNN<T, Activation, Acc>::save(string filename, int version) {
+	fstream output(filename, ios::out | ios::binary);
+
+	//Make sure Connections hold their latest states
+	syncCompiled();
+
+	if (version >= 2) {
+		//A single lane snapshot in the placement of this network
+		CompiledGraph<T, Activation, Acc> graph;
+		graph.setNodeOrder(nodeOrder);
+		graph.compile(connectionPool, inputNodes, outputNodes, graphNodes, 1, activations);
+		graph.save(connectionPool, output, activations, version);
+		output.close();
+		return;
+	}
+
+	//Write input nodes
+	output << "InputNodes=" << inputNodes.size() << endl;
+
+	//Write hidden nodes
+	output << "HiddenNodes=" << graphNodes.size() << endl;
+
+	//Write output nodes
+	output << "OutputNodes=" << outputNodes.size() << endl;
+
+	//Write all connections
+	output << "Connections=" << con.size() << endl;
+	for (ConnectionHandle h : con)
+		connectionPool[h].writeToFile(output);
+
+	//Write activation functions, only if some nodes do not use Activation
+	if (!activations.empty()) {
+		output << "Activations=" << activations.size() << endl;
+		output.write(reinterpret_cast<char*>(activations.data()), activations.size());
+	}
+
+	output.close();
+}
+
+template <class T, class Activation, class Acc>
+void EvolutionGNN<T, Activation, Acc>::removeDisconnectedConnections() {
+	//Connections removed by removeConnection() never stay in node lists,
+	//so there is usually nothing to do
+	bool found = false;
+	for (int i = 0; i < con.size() && !found; ++i)
+		found = connectionPool[con[i]].disconnected();
+	if (!found)return;
+
+	invalidateCompiled();
+	partition.clear();
+	liveValid = false;
+	settleValid = false;
+	invalidateQuantized();
+
+	//Remove useless connectinos for each input Node
+	for (int i = 0; i < inputNodes.size(); ++i)
+		inputNodes[i].removeDisconnectedConnections(connectionPool);
+
+	//Remove useless connectinos for each output Node
+	for (int i = 0; i < outputNodes.size(); ++i)
+		outputNodes[i].removeDisconnectedConnections(connectionPool);
+
+	//Remove useless connections for each hidden node
+	for (int i = 0; i < graphNodes.size(); ++i)
+		graphNodes[i].removeDisconnectedConnections(connectionPool);
+
+	//Remove disconnected connections, keeping the order of the others
+	int count = 0;
+	for (int i = 0; i < con.size(); ++i)
+		if (!connectionPool[con[i]].disconnected()) {
+			con[count] = con[i];
+			connectionPool[con[count]].setIndex(count);
+			++count;
+		}
+		else
+			connectionPool.release(con[i]);
+	con.resize(count);
+}
+
+template <class T, class Activation, class Acc>
+void EvolutionGNN<T, Activation, Acc>::removeConnection(int index) {
+	partition.clear();
+	liveValid = false;
+	settleValid = false;
+	invalidateQuantized();
+
+	ConnectionHandle handle = con[index];
+	int inNodeId = connectionPool[handle].getInNodeId();
+	int outNodeId = connectionPool[handle].getOutNodeId();
+	int inConIndex = connectionPool[handle].getInConIndex();
+
+	//Detach from both nodes
+	getNode(inNodeId).removeOutCon(connectionPool, handle);
+	getNode(outNodeId).removeInCon(connectionPool, handle);
+
+	//Free its slot in the compiled graph, compile again once too many are free
+	if (compiledValid) {
+		compiled.removeConnection(outNodeId, inConIndex);
+		if (compiled.needsCompaction())invalidateCompiled();
+	}
+
+	//Swap and pop
+	con[index] = con.back();
+	connectionPool[con[index]].setIndex(index);
+	con.pop_back();
+	connectionPool.release(handle);
+}
+
+template <class T, class Activation, class Acc>
+void EvolutionGNN<T, Activation, Acc>::addRandomConnection(int count) {
+	for (int i = 0; i < count; ++i) {
+		int node1 = random.nextInt(nodeCount);
+		int node2 = random.nextInt(nodeCount - inputNodes.size()) + inputNodes.size();
+		addConnection(node1, node2, random.nextDouble() * 20.0 - 10.0);
+	}
+}
+
+template <class T, class Activation, class Acc>
+void EvolutionGNN<T, Activation, Acc>::addConnection(int node1, int node2, T weight, T ABuffer, T BBuffer, bool useABuffer) {
+	//Create Connection
+	ConnectionHandle handle = connectionPool.create(node1, node2, weight, ABuffer, BBuffer, useABuffer);
+
+	partition.clear();
+	liveValid = false;
+	settleValid = false;
+	invalidateQuantized();
+
+	//Added to Connections
+	connectionPool[handle].setIndex(con.size());
+	con.push_back(handle);
+
+	//Added as outCon to node1
+	getNode(node1).addOutCon(connectionPool, handle);
+
+	//Added as inCon to node2
+	getNode(node2).addInCon(connectionPool, handle);
+
+	//A removed node connected again is live, so addNodes() must not hand it out
+	for (int id : { node1, node2 }) {
+		if (freeNodes.empty())break;
+		auto free = find(freeNodes.begin(), freeNodes.end(), id);
+		if (free == freeNodes.end())continue;
+		*free = freeNodes.back();
+		freeNodes.pop_back();
+	}
+
+	//Fill a free slot of the compiled graph, or compile again if there is none
+	if (compiledValid && !compiled.addConnection(connectionPool, handle))
+		invalidateCompiled();
+}
+
+template <class T, class Activation, class Acc>
+GraphNode<T>& EvolutionGNN<T, Activation, Acc>::getNode(int id) {
+	if (id < inputNodes.size())
+		return inputNodes[id];
+	if (id < inputNodes.size() + outputNodes.size())
+		return outputNodes[id - inputNodes.size()];
+
+	//Connections may refer to nodes that do not exist yet
+	while (id >= nodeCount) {
+		invalidateCompiled();
+		partition.clear();
+		liveValid = false;
+		settleValid = false;
+		invalidateQuantized();
+		graphNodes.push_back(GraphNode<T>(nodeCount));
+		++nodeCount;
+	}
+	return graphNodes[id - inputNodes.size() - outputNodes.size()];
+}
+
+template <class T, class Activation, class Acc>
+vector<int> EvolutionGNN<T, Activation, Acc>::addNodes(int count) {
+	vector<int> ids;
+	for (int i = 0; i < count; ++i) {
+		//A removed node is still compiled as a node without connections
+		if (!freeNodes.empty()) {
+			ids.push_back(freeNodes.back());
+			freeNodes.pop_back();
+			continue;
+		}
+
+		invalidateCompiled();
+		partition.clear();
+		liveValid = false;
+		settleValid = false;
+		invalidateQuantized();
+		ids.push_back(nodeCount);
+		graphNodes.push_back(GraphNode<T>(nodeCount));
+		++nodeCount;
+	}
+	return ids;
+}
+
+template <class T, class Activation, class Acc>
+void EvolutionGNN<T, Activation, Acc>::removeNode(int id) {
+	if (id < inputNodes.size() + outputNodes.size() || id >= nodeCount)return;
+
+	GraphNode<T>& node = getNode(id);
+	while (!node.getInCon().empty())
+		removeConnection(connectionPool[node.getInCon().back()].getIndex());
+	while (!node.getOutCon().empty())
+		removeConnection(connectionPool[node.getOutCon().back()].getIndex());
+
+	if (getActivation(id) != ACTIVATION_DEFAULT)
+		setActivation(id, ACTIVATION_DEFAULT);
+
+	//A node removed twice is only listed once
+	if (find(freeNodes.begin(), freeNodes.end(), id) == freeNodes.end())
+		freeNodes.push_back(id);
+}
+
+template <class T, class Activation, class Acc>
+T EvolutionGNN<T, Activation, Acc>::getOutput(int index) {
+	if (quantizedValid)
+		return quantized.getValue(inputNodes.size() + index);
+	if (useCompiled && compiledValid)
+		return compiled.getValue(inputNodes.size() + index);
+	return outputNodes[index].get();
+}
+
+template <class T, class Activation, class Acc>
+T EvolutionGNN<T, Activation, Acc>::getOutput(int lane, int index) {
+	if (lane < 0 || lane >= batchSize)return T(0);
+	if (lane == 0)return getOutput(index);
+
+	//Only a compiled graph carries more than one lane
+	prepareCompiled();
+	return compiled.getValue(inputNodes.size() + index, lane);
+}
+
+template <class T, class Activation, class Acc>
+void EvolutionGNN<T, Activation, Acc>::getOutputs(vector<vector<T>>& batch) {
+	batch.resize(batchSize);
+	for (int lane = 0; lane < batchSize; ++lane) {
+		batch[lane].resize(outputNodes.size());
+		for (int i = 0; i < outputNodes.size(); ++i)
+			batch[lane][i] = getOutput(lane, i);
+	}
+}
+
+template <class T, class Activation, class Acc>
+void EvolutionGNN<T, Activation, Acc>::setBatchSize(int lanes) {
+	if (lanes < 1)lanes = 1;
+
+	//Lanes are laid out side by side, so changing it needs a new compiled graph
+	invalidateCompiled();
+	batchSize = lanes;
+	compile();
+}
+
+template <class T, class Activation, class Acc>
+int EvolutionGNN<T, Activation, Acc>::getBatchSize() {
+	return batchSize;
+}
+
+template <class T, class Activation, class Acc>
+void EvolutionGNN<T, Activation, Acc>::setTanhMode(TanhMode mode) {
+	tanhMode = mode;
+	compiled.setTanhMode(mode);
+}
+
+template <class T, class Activation, class Acc>
+TanhMode EvolutionGNN<T, Activation, Acc>::getTanhMode() {
+	return tanhMode;
+}
+
+template <class T, class Activation, class Acc>
+void EvolutionGNN<T, Activation, Acc>::setNodeOrder(NodeOrder order) {
+	invalidateCompiled();
+	nodeOrder = order;
+}
+
+template <class T, class Activation, class Acc>
+NodeOrder EvolutionGNN<T, Activation, Acc>::getNodeOrder() {
+	return nodeOrder;
+}
+
+template <class T, class Activation, class Acc>
+void EvolutionGNN<T, Activation, Acc>::setActivation(int id, int activation) {
+	invalidateCompiled();
+	invalidateQuantized();
+	if (activations.size() < nodeCount)
+		activations.resize(nodeCount, ACTIVATION_DEFAULT);
+	activations[id] = activation;
+}
+
+template <class T, class Activation, class Acc>
+void EvolutionGNN<T, Activation, Acc>::setRandom(const EvoRandom& random) {
+	this->random = random;
+}
+
+template <class T, class Activation, class Acc>
+EvoRandom& EvolutionGNN<T, Activation, Acc>::getRandom() {
+	return random;
+}
+
+template <class T, class Activation, class Acc>
+void EvolutionGNN<T, Activation, Acc>::seed(unsigned long long seed) {
+	random.seed(seed);
+}
+
+template <class T, class Activation, class Acc>
+int EvolutionGNN<T, Activation, Acc>::getActivation(int id) {
+	if (id < 0 || id >= activations.size())
+		return ACTIVATION_DEFAULT;
+	return activations[id];
+}
+
+template <class T, class Activation, class Acc>
+void EvolutionGNN<T, Activation, Acc>::compile() {
+	//Only one copy holds the latest states, so the quantized one is written back and dropped
+	dequantize();
+
+	compiled.setNodeOrder(nodeOrder);
+	compiled.compile(connectionPool, inputNodes, outputNodes, graphNodes, batchSize, activations);
+	compiled.setTanhMode(tanhMode);
+	compiled.setEventDriven(eventDriven, eventEpsilon);
+	compiled.setSettling(settling);
+	useCompiled = true;
+	compiledValid = true;
+	partition.clear();
+}
+
+template <class T, class Activation, class Acc>
+void EvolutionGNN<T, Activation, Acc>::decompile() {
+	syncCompiled();
+	compiled.clear();
+	useCompiled = false;
+	compiledValid = false;
+	batchSize = 1;
+	partition.clear();
+}
+
+template <class T, class Activation, class Acc>
+bool EvolutionGNN<T, Activation, Acc>::isCompiled() {
+	return useCompiled;
+}
+
+template <class T, class Activation, class Acc>
+void EvolutionGNN<T, Activation, Acc>::syncCompiled() {
+	//compile() and quantize() drop each other, so at most one copy is valid
+	if (quantizedValid) {
+		quantized.writeBack(connectionPool);
+		for (int i = 0; i < outputNodes.size(); ++i)
+			outputNodes[i].set(quantized.getValue(inputNodes.size() + i));
+		return;
+	}
+	if (!compiledValid)return;
+
+	compiled.writeBack(connectionPool);
+	for (int i = 0; i < outputNodes.size(); ++i)
+		outputNodes[i].set(compiled.getValue(inputNodes.size() + i));
+}
+
+template <class T, class Activation, class Acc>
+bool EvolutionGNN<T, Activation, Acc>::quantize(int bits, T range) {
+	if (bits != 8 && bits != 16)return false;
+
+	//Connections hold the latest states, from which the copy is built
+	decompile();
+	invalidateQuantized();
+	quantizeBits = bits;
+	quantizeRange = range;
+	prepareQuantized();
+	return true;
+}
+
+template <class T, class Activation, class Acc>
+void EvolutionGNN<T, Activation, Acc>::dequantize() {
+	invalidateQuantized();
+	quantizeBits = 0;
+}
+
+template <class T, class Activation, class Acc>
+int EvolutionGNN<T, Activation, Acc>::getQuantizeBits() {
+	return quantizeBits;
+}
+
+template <class T, class Activation, class Acc>
+void EvolutionGNN<T, Activation, Acc>::prepareQuantized() {
+	if (quantizedValid || quantizeBits == 0)return;
+	quantized.build(connectionPool, inputNodes, outputNodes, graphNodes, quantizeBits, quantizeRange, activations);
+	quantizedValid = true;
+}
+
+template <class T, class Activation, class Acc>
+void EvolutionGNN<T, Activation, Acc>::invalidateQuantized() {
+	if (!quantizedValid)return;
+
+	syncCompiled();
+	quantized.clear();
+	quantizedValid = false;
+}
+
+template <class T, class Activation, class Acc>
+void EvolutionGNN<T, Activation, Acc>::prepareCompiled() {
+	if (!compiledValid)
+		compile();
+}
+
+template <class T, class Activation, class Acc>
+void EvolutionGNN<T, Activation, Acc>::invalidateCompiled() {
+	if (!compiledValid)return;
+
+	syncCompiled();
+	compiled.clear();
+	compiledValid = false;
+}
+
+template <class T, class Activation, class Acc>
+void EvolutionGNN<T, Activation, Acc>::runCompiled() {
+	prepareCompiled();
+
+	int numOfThread = determineNumberOfThread();
+	int nodes = compiled.getNodeSize();
+	int connections = compiled.getSlotSize();
+	bool parity = compiled.getParity();
+
+	//Components depend on each other in order
+	if (settling) {
+		perf.addSteps(1, (long long)con.size() * batchSize);
+		perf.timeSerial(PHASE_RUN, [&]() { compiled.runSettled(parity); });
+		return;
+	}
+
+	//Sparse steps are not worth splitting over workers
+	if (eventDriven && batchSize == 1) {
+		long long edges = 0;
+		perf.timeSerial(PHASE_RUN, [&]() { edges = compiled.runEvents(parity); });
+		perf.addSteps(1, edges);
+		return;
+	}
+
+	perf.addSteps(1, (long long)con.size() * batchSize);
+	if (numOfThread <= 1) {
+		perf.timeSerial(PHASE_RUN, [&]() { compiled.runNodes(0, nodes, parity); });
+		perf.timeSerial(PHASE_FLIP, [&]() { compiled.writeConnections(0, connections, parity); });
+	}
+	else {
+		preparePartition(numOfThread);
+		atomic<int> next(0);
+		WorkerPool& pool = prepareWorkerPool();
+		perf.beginJob(pool.getWorkerCount());
+		pool.execute([&](int id, int) {
+			perf.enterJob(id);
+			if (id < numOfThread)
+				perf.timeWork(id, 0, [&]() {
+					runChunks(id, numOfThread, next, [&](int startId, int endId) { compiled.runNodes(startId, endId, parity); });
+				});
+
+			//Every node has to be calculated before any connection is written
+			pool.wait();
+			if (id == 0)perf.endPhase(PHASE_RUN, 0, numOfThread);
+
+			if (id < numOfThread)
+				perf.timeWork(id, 1, [&]() {
+					compiled.writeConnections(1.0 * id / numOfThread * connections, 1.0 * (id + 1) / numOfThread * connections, parity);
+				});
+			perf.leaveJob(id);
+		});
+		perf.endJob(PHASE_FLIP, 1, numOfThread);
+	}
+}
+
+template <class T, class Activation, class Acc>
+void EvolutionGNN<T, Activation, Acc>::runSteps(int steps) {
+	//The set of visited nodes shrinks after the warm steps, which the job below can not follow
+	if (!useCompiled && pruning) {
+		prepareLiveNodes();
+		for (; steps > 0 && pruneWarmSteps > 0; --steps) {
+			run();
+			flipBuffer();
+		}
+	}
+
+	int numOfThread = determineNumberOfThread();
+	if (numOfThread <= 1 || settling || quantizeBits > 0 || (useCompiled && eventDriven && batchSize == 1)) {
+		for (int i = 0; i < steps; ++i) {
+			run();
+			flipBuffer();
+		}
+		return;
+	}
+
+	if (useCompiled)
+		prepareCompiled();
+	preparePartition(numOfThread);
+	int connections = compiled.getSlotSize();
+	bool parity = compiled.getParity();
+
+	//Chunks left in the current run and flip phase, reset by worker 0 once the phase is over
+	atomic<int> runNext(0), flipNext(0);
+
+	WorkerPool& pool = prepareWorkerPool();
+	perf.addSteps(steps, (long long)con.size() * (useCompiled ? batchSize : 1));
+	perf.beginJob(pool.getWorkerCount());
+	pool.execute([&](int id, int) {
+		bool active = id < numOfThread;
+		int start = 1.0 * id / numOfThread * connections;
+		int end = 1.0 * (id + 1) / numOfThread * connections;
+		perf.enterJob(id);
+
+		for (int i = 0; i < steps; ++i) {
+			if (useCompiled) {
+				//Buffers flip every step, so parity follows the step number
+				bool p = parity != bool(i & 1);
+				if (active)perf.timeWork(id, 0, [&]() {
+					runChunks(id, numOfThread, runNext, [&](int startId, int endId) { compiled.runNodes(startId, endId, p); });
+				});
+				pool.wait();
+				if (id == 0) {
+					runNext = 0;
+					perf.endPhase(PHASE_RUN, 0, numOfThread);
+				}
+				if (active)perf.timeWork(id, 1, [&]() { compiled.writeConnections(start, end, p); });
+				pool.wait();
+				if (id == 0)perf.endPhase(PHASE_FLIP, 1, numOfThread);
+			}
+			else {
+				if (active)perf.timeWork(id, 0, [&]() {
+					runChunks(id, numOfThread, runNext, [&](int startId, int endId) {
+						if (pruning)runLiveNodes(startId, endId);
+						else
+							thread_run(startId, endId, id);
+					});
+				});
+				pool.wait();
+				if (id == 0) {
+					runNext = 0;
+					perf.endPhase(PHASE_RUN, 0, numOfThread);
+				}
+				if (active)perf.timeWork(id, 1, [&]() {
+					runChunks(id, numOfThread, flipNext, [&](int startId, int endId) {
+						if (pruning)flipLiveNodes(startId, endId);
+						else
+							thread_flipBuffer(startId, endId, id);
+					});
+				});
+				pool.wait();
+				if (id == 0) {
+					flipNext = 0;
+					perf.endPhase(PHASE_FLIP, 1, numOfThread);
+				}
+			}
+		}
+		perf.leaveJob(id);
+	});
+	perf.endJob();
+
+	if (useCompiled && steps % 2)
+		compiled.flipBuffer();
+}
+
+template <class T, class Activation, class Acc>
+int EvolutionGNN<T, Activation, Acc>::runUntilStable(int maxSteps, T epsilon, int* steps) {
+	vector<T> snapshot, state;
+	int power = 1, distance = 0;
+	for (int step = 1; step <= maxSteps; ++step) {
+		run();
+		flipBuffer();
+		captureState(state);
+
+		if (step > 1) {
+			++distance;
+			bool same = state.size() == snapshot.size();
+			for (int i = 0; i < state.size() && same; ++i) {
+				if (epsilon == T(0))
+					same = !memcmp(&state[i], &snapshot[i], sizeof(T));
+				else {
+					T d = state[i] - snapshot[i];
+					same = d <= epsilon && d >= -epsilon;
+				}
+			}
+			if (same) {
+				if (steps)*steps = step;
+				return distance;
+			}
+			if (distance < power)continue;
+			power *= 2;
+		}
+
+		//Once the snapshot is inside a cycle and the interval covers its period,
+		//the first match is at the period
+		snapshot.swap(state);
+		distance = 0;
+	}
+
+	if (steps)*steps = maxSteps;
+	return 0;
+}
+
+template <class T, class Activation, class Acc>
+void EvolutionGNN<T, Activation, Acc>::captureState(vector<T>& state) {
+	state.clear();
+	if (quantizedValid) {
+		for (int id = inputNodes.size(); id < nodeCount; ++id)
+			state.push_back(quantized.getValue(id));
+		return;
+	}
+	if (useCompiled && compiledValid) {
+		int lanes = compiled.getLaneSize();
+		for (int id = inputNodes.size(); id < nodeCount; ++id)
+			for (int lane = 0; lane < lanes; ++lane)
+				state.push_back(compiled.getValue(id, lane));
+		return;
+	}
+
+	//Every hidden node writes the same value to all of its out-going connections,
+	//which is on the read side after flipBuffer()
+	for (int i = 0; i < outputNodes.size(); ++i)
+		state.push_back(outputNodes[i].get());
+	for (int i = 0; i < graphNodes.size(); ++i) {
+		vector<ConnectionHandle>& out = graphNodes[i].getOutCon();
+		if (out.empty())continue;
+		Connection<T>& c = connectionPool[out[0]];
+		state.push_back(c.getBufferState() ? c.getBBuffer() : c.getABuffer());
+	}
+}
+
+template <class T, class Activation, class Acc>
+WorkerPool& EvolutionGNN<T, Activation, Acc>::prepareWorkerPool() {
+	if (!workerPool)
+		workerPool = make_shared<WorkerPool>(threadCount);
+	return *workerPool;
+}
+
+template <class T, class Activation, class Acc>
+void EvolutionGNN<T, Activation, Acc>::setWorkerPool(shared_ptr<WorkerPool> pool) {
+	workerPool = pool;
+}
+
+template <class T, class Activation, class Acc>
+shared_ptr<WorkerPool> EvolutionGNN<T, Activation, Acc>::getWorkerPool() {
+	prepareWorkerPool();
+	return workerPool;
+}
+
+template <class T, class Activation, class Acc>
+template <class Work>
+void EvolutionGNN<T, Activation, Acc>::runChunks(int id, int, atomic<int>& next, const Work& work) {
+	if (!dynamicScheduling) {
+		work(partition[id], partition[id + 1]);
+		return;
+	}
+
+	int chunks = partition.size() - 1;
+	for (int chunk = next++; chunk < chunks; chunk = next++)
+		work(partition[chunk], partition[chunk + 1]);
+}
+
+template <class T, class Activation, class Acc>
+void EvolutionGNN<T, Activation, Acc>::preparePartition(int numOfThread) {
+	//Dynamic scheduling hands out several smaller chunks per worker
+	int chunks = dynamicScheduling ? numOfThread * 4 : numOfThread;
+	if (partition.size() == chunks + 1)return;
+
+	//Work of each node, the compiled graph only reads incoming connections
+	//while GraphNode::run() also writes out-going ones
+	//In pruning mode chunks are ranges of liveNodes instead of ids
+	bool live = !useCompiled && pruning && !settling;
+	int nodes = useCompiled ? compiled.getNodeSize() : live ? liveCount : nodeCount;
+	vector<long long> prefix(nodes + 1, 0);
+	for (int i = 0; i < nodes; ++i) {
+		long long work = 1;
+		if (useCompiled)
+			work += compiled.getInDegree(i);
+		else {
+			GraphNode<T>& node = getNode(live ? liveNodes[i] : i);
+			work += node.getInCon().size() + node.getOutCon().size();
+		}
+		prefix[i + 1] = prefix[i] + work;
+	}
+
+	//Chunk c ends at the first node where the prefix sum reaches c / chunks of the total
+	partition.assign(chunks + 1, nodes);
+	partition[0] = 0;
+	for (int c = 1; c < chunks; ++c) {
+		long long target = prefix[nodes] * c / chunks;
+		partition[c] = lower_bound(prefix.begin() + partition[c - 1], prefix.end(), target) - prefix.begin();
+		if (partition[c] > nodes)partition[c] = nodes;
+	}
+}
+
+template <class T, class Activation, class Acc>
+void EvolutionGNN<T, Activation, Acc>::setDynamicScheduling(bool dynamic) {
+	dynamicScheduling = dynamic;
+	partition.clear();
+}
+
+template <class T, class Activation, class Acc>
+bool EvolutionGNN<T, Activation, Acc>::getDynamicScheduling() {
+	return dynamicScheduling;
+}
+
+template <class T, class Activation, class Acc>
+PerfCounters& EvolutionGNN<T, Activation, Acc>::getPerfCounters() {
+	return perf;
+}
+
+template <class T, class Activation, class Acc>
+void EvolutionGNN<T, Activation, Acc>::setEventDriven(bool enabled, T epsilon) {
+	eventDriven = enabled;
+	eventEpsilon = epsilon;
+	compiled.setEventDriven(enabled, epsilon);
+	if (enabled && !useCompiled)
+		compile();
+}
+
+template <class T, class Activation, class Acc>
+bool EvolutionGNN<T, Activation, Acc>::isEventDriven() {
+	return eventDriven;
+}
+
+template <class T, class Activation, class Acc>
+int EvolutionGNN<T, Activation, Acc>::getActiveSize() {
+	return compiled.getActiveSize();
+}
+
+template <class T, class Activation, class Acc>
+void EvolutionGNN<T, Activation, Acc>::setPruning(bool enabled) {
+	pruning = enabled;
+	liveValid = false;
+	partition.clear();
+}
+
+template <class T, class Activation, class Acc>
+bool EvolutionGNN<T, Activation, Acc>::isPruning() {
+	return pruning;
+}
+
+template <class T, class Activation, class Acc>
+int EvolutionGNN<T, Activation, Acc>::getLiveSize() {
+	prepareLiveNodes();
+	return liveCount;
+}
+
+template <class T, class Activation, class Acc>
+void EvolutionGNN<T, Activation, Acc>::prepareLiveNodes() {
+	if (liveValid)return;
+	int inputCount = inputNodes.size();
+	int outputCount = outputNodes.size();
+
+	//Nodes with a path to some output
+	vector<char> reaches(nodeCount, 0);
+	vector<int> queue;
+	for (int id = inputCount; id < inputCount + outputCount; ++id) {
+		reaches[id] = 1;
+		queue.push_back(id);
+	}
+	for (int head = 0; head < queue.size(); ++head)
+		for (ConnectionHandle in : getNode(queue[head]).getInCon()) {
+			int from = connectionPool[in].getInNodeId();
+			if (reaches[from])continue;
+			reaches[from] = 1;
+			queue.push_back(from);
+		}
+
+	//Hidden nodes fed by neither an input nor a cycle, every other node keeps an in-coming
+	//connection from a node that is never removed
+	//Output nodes are never removed either, as their out-going connections are flipped
+	//but never written, so they keep alternating
+	//A node at depth d only depends on nodes without in-coming connections d steps ago,
+	//so its value is fixed after d + 1 steps
+	vector<int> remaining(nodeCount, 0), depth(nodeCount, 0);
+	vector<char> settles(nodeCount, 0);
+	queue.clear();
+	for (int id = inputCount + outputCount; id < nodeCount; ++id) {
+		remaining[id] = getNode(id).getInCon().size();
+		if (remaining[id] == 0)queue.push_back(id);
+	}
+	for (int head = 0; head < queue.size(); ++head) {
+		int id = queue[head];
+		settles[id] = 1;
+		for (ConnectionHandle out : getNode(id).getOutCon()) {
+			int to = connectionPool[out].getOutNodeId();
+			depth[to] = max(depth[to], depth[id] + 1);
+			if (--remaining[to] == 0)queue.push_back(to);
+		}
+	}
+
+	liveNodes.clear();
+	for (int id = 0; id < nodeCount; ++id)
+		if (reaches[id] && !settles[id])liveNodes.push_back(id);
+	fedCount = liveNodes.size();
+
+	pruneWarmSteps = 0;
+	for (int id = inputCount + outputCount; id < nodeCount; ++id)
+		if (reaches[id] && settles[id]) {
+			liveNodes.push_back(id);
+			pruneWarmSteps = max(pruneWarmSteps, depth[id] + 1);
+		}
+	liveCount = pruneWarmSteps > 0 ? liveNodes.size() : fedCount;
+
+	partition.clear();
+	liveValid = true;
+}
+
+template <class T, class Activation, class Acc>
+void EvolutionGNN<T, Activation, Acc>::runLiveNodes(int start, int end) {
+	for (int i = start; i < end; ++i)
+		runNode(liveNodes[i]);
+}
+
+template <class T, class Activation, class Acc>
+void EvolutionGNN<T, Activation, Acc>::runNode(int id) {
+	int inputCount = inputNodes.size();
+	int outputCount = outputNodes.size();
+	if (id < inputCount)
+		inputNodes[id].run(connectionPool);
+	else if (id < inputCount + outputCount)
+		outputNodes[id - inputCount].template run<Activation, Acc>(connectionPool, getActivation(id));
+	else
+		graphNodes[id - inputCount - outputCount].template run<Activation, Acc>(connectionPool, getActivation(id));
+}
+
+template <class T, class Activation, class Acc>
+void EvolutionGNN<T, Activation, Acc>::setSettling(bool enabled) {
+	settling = enabled;
+	settleValid = false;
+	compiled.setSettling(enabled);
+}
+
+template <class T, class Activation, class Acc>
+bool EvolutionGNN<T, Activation, Acc>::isSettling() {
+	return settling;
+}
+
+template <class T, class Activation, class Acc>
+void EvolutionGNN<T, Activation, Acc>::prepareSettle() {
+	if (settleValid)return;
+	int inputCount = inputNodes.size();
+	int outputCount = outputNodes.size();
+	auto isOutput = [&](int id) {
+		return id >= inputCount && id < inputCount + outputCount;
+	};
+
+	//Successors of each node, input nodes read nothing and output nodes write nothing
+	vector<int> offsets(nodeCount + 1, 0), targets;
+	for (int id = 0; id < nodeCount; ++id) {
+		offsets[id + 1] = offsets[id];
+		if (isOutput(id))continue;
+		for (ConnectionHandle out : getNode(id).getOutCon()) {
+			int to = connectionPool[out].getOutNodeId();
+			if (to < inputCount)continue;
+			targets.push_back(to);
+			++offsets[id + 1];
+		}
+	}
+
+	vector<int> component;
+	int components = findComponents(nodeCount, offsets, targets, component);
+
+	//Counting sort of node ids by component
+	vector<int> first(components + 1, 0);
+	for (int id = 0; id < nodeCount; ++id)
+		++first[component[id] + 1];
+	for (int c = 0; c < components; ++c)
+		first[c + 1] += first[c];
+	settleOrder.resize(nodeCount);
+	for (int id = 0; id < nodeCount; ++id)
+		settleOrder[first[component[id]]++] = id;
+
+	crossOffsets.assign(1, 0);
+	crossCon.clear();
+	for (int id : settleOrder) {
+		if (!isOutput(id))
+			for (ConnectionHandle out : getNode(id).getOutCon()) {
+				int to = connectionPool[out].getOutNodeId();
+				if (to >= inputCount && component[to] != component[id])
+					crossCon.push_back(out);
+			}
+		crossOffsets.push_back(crossCon.size());
+	}
+
+	settleValid = true;
+}
+
+template <class T, class Activation, class Acc>
+void EvolutionGNN<T, Activation, Acc>::runSettled() {
+	prepareSettle();
+	for (int i = 0; i < settleOrder.size(); ++i) {
+		runNode(settleOrder[i]);
+
+		//Later components read the value just written in this step
+		for (int k = crossOffsets[i]; k < crossOffsets[i + 1]; ++k) {
+			Connection<T>& c = connectionPool[crossCon[k]];
+			if (c.getBufferState())c.setBBuffer(c.getABuffer());
+			else
+				c.setABuffer(c.getBBuffer());
+		}
+	}
+}
+
+template <class T, class Activation, class Acc>
+void EvolutionGNN<T, Activation, Acc>::flipLiveNodes(int start, int end) {
+	for (int i = start; i < end; ++i)
+		getNode(liveNodes[i]).flipBuffer(connectionPool);
+}
+
+template <class T, class Activation, class Acc>
+double EvolutionGNN<T, Activation, Acc>::taskArranger(double x) {
+	//return pow(x, M_E);
+	return x;
+}
+
+template <class T, class Activation, class Acc>
+int EvolutionGNN<T, Activation, Acc>::determineNumberOfThread() {
+	//Current method depends on number of connections
+	int maxThread = threadCount;
+	if (workerPool && workerPool->getWorkerCount() < maxThread)
+		maxThread = workerPool->getWorkerCount();
+	if (maxThread <= 0)maxThread = 1;
+
+	int calculated = con.size() / 100000;
+	if (calculated <= 0)calculated = 1;
+	if (calculated > maxThread)calculated = maxThread;
+
+	return calculated;
+}
+
+template <class T, class Activation, class Acc>
+void EvolutionGNN<T, Activation, Acc>::thread_run(int startId, int endId, int dummy) {
+	//cout << "Id = " << dummy << "  from " << startId << " to " << endId << endl;
+	//cout << dummy << " Started." << endl;
+	//Run inputNodes
+	if (startId < inputNodes.size()) {
+		int start = startId;
+		int end = (endId < inputNodes.size() ? endId : inputNodes.size());
+		for (int i = start; i < end; ++i)
+			inputNodes[i].run(connectionPool);
+	}
+
+	//Run outputNodes
+	if (startId < inputNodes.size() + outputNodes.size() && endId > inputNodes.size()) {
+		int start = (startId < inputNodes.size() ? inputNodes.size() : startId) - inputNodes.size();
+		int end = (endId > inputNodes.size() + outputNodes.size() ? inputNodes.size() + outputNodes.size() : endId) - inputNodes.size();
+		for (int i = start; i < end; ++i)
+			outputNodes[i].template run<Activation, Acc>(connectionPool, getActivation(inputNodes.size() + i));
+	}
+
+	//Run hiddenNodes
+	if (endId > inputNodes.size() + outputNodes.size()) {
+		int start = (startId < inputNodes.size() + outputNodes.size() ? inputNodes.size() + outputNodes.size() : startId) - inputNodes.size() - outputNodes.size();
+		int end = endId - inputNodes.size() - outputNodes.size();
+		for (int i = start; i < end; ++i)
+			graphNodes[i].template run<Activation, Acc>(connectionPool, getActivation(inputNodes.size() + outputNodes.size() + i));
+	}
+	//cout << dummy << " Completed." << endl;
+}
+
+template <class T, class Activation, class Acc>
+void EvolutionGNN<T, Activation, Acc>::run() {
+	if (quantizeBits > 0) {
+		prepareQuantized();
+		perf.addSteps(1, con.size());
+		perf.timeSerial(PHASE_RUN, [&]() { quantized.runNodes(); });
+		perf.timeSerial(PHASE_FLIP, [&]() { quantized.writeConnections(); });
+		return;
+	}
+
+	if (useCompiled) {
+		runCompiled();
+		return;
+	}
+
+	if (settling) {
+		perf.addSteps(1, con.size());
+		perf.timeSerial(PHASE_RUN, [&]() { runSettled(); });
+		return;
+	}
+
+	if (pruning)
+		prepareLiveNodes();
+
+	int numOfThread = determineNumberOfThread();
+	perf.addSteps(1, con.size());
+	if (numOfThread <= 1) {
+		perf.timeSerial(PHASE_RUN, [&]() {
+			if (pruning) {
+				runLiveNodes(0, liveCount);
+				return;
+			}
+
+			//Order doesn't matter
+
+			//Run all input nodes
+			for (int i = 0; i < inputNodes.size(); ++i)
+				inputNodes[i].run(connectionPool);
+
+			//Run all output nodes
+			for (int i = 0; i < outputNodes.size(); ++i)
+				outputNodes[i].template run<Activation, Acc>(connectionPool, getActivation(inputNodes.size() + i));
+
+			//Run all hidden nodes
+			for (int i = 0; i < graphNodes.size(); ++i)
+				graphNodes[i].template run<Activation, Acc>(connectionPool, getActivation(inputNodes.size() + outputNodes.size() + i));
+		});
+	}
+	else {
+
+		//Considering multi-threaded execution
+		preparePartition(numOfThread);
+		atomic<int> next(0);
+		WorkerPool& pool = prepareWorkerPool();
+		perf.beginJob(pool.getWorkerCount());
+		pool.execute([&](int id, int) {
+			perf.enterJob(id);
+			if (id < numOfThread)
+				perf.timeWork(id, 0, [&]() {
+					runChunks(id, numOfThread, next, [&](int startId, int endId) {
+						if (pruning)runLiveNodes(startId, endId);
+						else
+							thread_run(startId, endId, id);
+					});
+				});
+			perf.leaveJob(id);
+		});
+		perf.endJob(PHASE_RUN, 0, numOfThread);
+	}
+}
+
+template <class T, class Activation, class Acc>
+void EvolutionGNN<T, Activation, Acc>::thread_flipBuffer(int startId, int endId, int dummy) {
+	//cout << "Id = " << dummy << "  from " << startId << " to " << endId << endl;
+	//cout << dummy << " Started." << endl;
+	//Run inputNodes
+	if (startId < inputNodes.size()) {
+		int start = startId;
+		int end = (endId < inputNodes.size() ? endId : inputNodes.size());
+		for (int i = start; i < end; ++i)
+			inputNodes[i].flipBuffer(connectionPool);
+	}
+
+	//Run outputNodes
+	if (startId < inputNodes.size() + outputNodes.size() && endId > inputNodes.size()) {
+		int start = (startId < inputNodes.size() ? inputNodes.size() : startId) - inputNodes.size();
+		int end = (endId > inputNodes.size() + outputNodes.size() ? inputNodes.size() + outputNodes.size() : endId) - inputNodes.size();
+		for (int i = start; i < end; ++i)
+			outputNodes[i].flipBuffer(connectionPool);
+	}
+
+	//Run hiddenNodes
+	if (endId > inputNodes.size() + outputNodes.size()) {
+		int start = (startId < inputNodes.size() + outputNodes.size() ? inputNodes.size() + outputNodes.size() : startId) - inputNodes.size() - outputNodes.size();
+		int end = endId - inputNodes.size() - outputNodes.size();
+		for (int i = start; i < end; ++i)
+			graphNodes[i].flipBuffer(connectionPool);
+	}
+	//cout << dummy << " Completed." << endl;
+}
+
+template <class T, class Activation, class Acc>
+void EvolutionGNN<T, Activation, Acc>::flipBuffer() {
+	if (quantizeBits > 0) {
+		prepareQuantized();
+		quantized.flipBuffer();
+		return;
+	}
+
+	if (useCompiled) {
+		prepareCompiled();
+		compiled.flipBuffer();
+		return;
+	}
+
+	//Settle mode flips every connection
+	bool pruning = this->pruning && !settling;
+	if (pruning)
+		prepareLiveNodes();
+
+	int numOfThread = determineNumberOfThread();
+	if (numOfThread <= 1) {
+		perf.timeSerial(PHASE_FLIP, [&]() {
+			if (pruning) {
+				flipLiveNodes(0, liveCount);
+				return;
+			}
+
+			//Order doesn't matter
+
+			//Flip input Nodes
+			for (int i = 0; i < inputNodes.size(); ++i)
+				inputNodes[i].flipBuffer(connectionPool);
+
+			//Flip output Nodes
+			for (int i = 0; i < outputNodes.size(); ++i)
+				outputNodes[i].flipBuffer(connectionPool);
+
+			//Flip hidden Nodes
+			for (int i = 0; i < graphNodes.size(); ++i)
+				graphNodes[i].flipBuffer(connectionPool);
+		});
+	}
+	else {
+		preparePartition(numOfThread);
+		atomic<int> next(0);
+		WorkerPool& pool = prepareWorkerPool();
+		perf.beginJob(pool.getWorkerCount());
+		pool.execute([&](int id, int) {
+			perf.enterJob(id);
+			if (id < numOfThread)
+				perf.timeWork(id, 0, [&]() {
+					runChunks(id, numOfThread, next, [&](int startId, int endId) {
+						if (pruning)flipLiveNodes(startId, endId);
+						else
+							thread_flipBuffer(startId, endId, id);
+					});
+				});
+			perf.leaveJob(id);
+		});
+		perf.endJob(PHASE_FLIP, 0, numOfThread);
+	}
+
+	//Settled nodes fed by neither an input nor a cycle are left out from now on
+	if (pruning && pruneWarmSteps > 0 && --pruneWarmSteps == 0) {
+		liveCount = fedCount;
+		partition.clear();
+	}
+}
+
+template <class T, class Activation, class Acc>
+void EvolutionGNN<T, Activation, Acc>::setInput(int index, T val) {
+	inputNodes[index] = val;
+	if (quantizedValid)
+		quantized.setValue(index, val);
+	if (useCompiled && compiledValid)
+		for (int lane = 0; lane < batchSize; ++lane)
+			compiled.setValue(index, val, lane);
+}
+
+template <class T, class Activation, class Acc>
+bool EvolutionGNN<T, Activation, Acc>::setInput(int lane, int index, T val) {
+	if (lane < 0 || lane >= batchSize)return false;
+
+	//Lane 0 is also held by the input nodes, from which every copy is built
+	if (lane == 0) {
+		inputNodes[index] = val;
+		if (quantizedValid)
+			quantized.setValue(index, val);
+	}
+
+	//Only a compiled graph carries more than one lane
+	if (useCompiled && (compiledValid || lane > 0)) {
+		prepareCompiled();
+		compiled.setValue(index, val, lane);
+	}
+	return true;
+}
+
+template <class T, class Activation, class Acc>
+void EvolutionGNN<T, Activation, Acc>::setInputs(const vector<vector<T>>& batch) {
+	for (int lane = 0; lane < batch.size() && lane < batchSize; ++lane)
+		for (int i = 0; i < batch[lane].size() && i < inputNodes.size(); ++i)
+			setInput(lane, i, batch[lane][i]);
+}
+
+template <class T, class Activation, class Acc>
+void EvolutionGNN<T, Activation, Acc>::cleanUp() {
+	this->inputNodes.clear();
+	this->outputNodes.clear();
+	this->graphNodes.clear();
+	this->freeNodes.clear();
+	this->con.clear();
+	this->connectionPool.clear();
+	this->activations.clear();
+	this->compiled.clear();
+	this->compiledValid = false;
+	this->partition.clear();
+	this->liveValid = false;
+	this->settleValid = false;
+	this->quantized.clear();
+	this->quantizedValid = false;
+}
+
+template <class T, class Activation, class Acc>
+int EvolutionGNN<T, Activation, Acc>::getConnectionSize() {
+	return con.size();
+}
+
+template <class T, class Activation, class Acc>
+int EvolutionGNN<T, Activation, Acc>::getOutputSize() {
+	return outputNodes.size();
+}
+
+template <class T, class Activation, class Acc>
+int EvolutionGNN<T, Activation, Acc>::getHiddenSize() {
+	return graphNodes.size() - freeNodes.size();
+}
+
+template <class T, class Activation, class Acc>
+int EvolutionGNN<T, Activation, Acc>::getInputSize() {
+	return inputNodes.size();
+}
+
+template <class T, class Activation, class Acc>
+void EvolutionGNN<T, Activation, Acc>::initialize(int inputCount, int outputCount, int threadCount) {
+	if (threadCount < 0)
+		this->threadCount = thread::hardware_concurrency() - 1;
+	else
+		this->threadCount = threadCount;
+	if (this->threadCount <= 0)
+		this->threadCount = 1;
+
+	//Remove everything in case not
+	this->cleanUp();
+
+	//Initialize it as initializer
+	for (int i = 0; i < inputCount; ++i)
+		this->inputNodes.push_back(InputGraphNode<T>(i));
+	for (int i = 0; i < outputCount; ++i)
+		this->outputNodes.push_back(OutputGraphNode<T>(i + inputCount));
+
+	nodeCount = inputCount + outputCount;
+}
+
+template <class T, class Activation, class Acc>
+EvolutionGNN<T, Activation, Acc>::EvolutionGNN(EvolutionGNN<T, Activation, Acc>& parentA, EvolutionGNN<T, Activation, Acc>& parentB, double AConRate, double BConRate, bool inheritMemory) {
+	threadCount = parentA.threadCount;
+	useCompiled = false;
+	compiledValid = false;
+	batchSize = 1;
+	tanhMode = TANH_EXACT;
+	nodeOrder = ORDER_ID;
+	dynamicScheduling = false;
+	eventDriven = false;
+	eventEpsilon = T(0);
+	pruning = false;
+	liveValid = false;
+	settling = false;
+	settleValid = false;
+	quantizeBits = 0;
+	quantizeRange = T(1);
+	quantizedValid = false;
+	liveCount = 0;
+	fedCount = 0;
+	pruneWarmSteps = 0;
+	random.seed(rand());
+	inherit(parentA, parentB, AConRate, BConRate, inheritMemory);
+}
+
+template <class T, class Activation, class Acc>
+EvolutionGNN<T, Activation, Acc>::EvolutionGNN(int inputCount, int outputCount, int threadCount) {
+	if (threadCount < 0)
+		this->threadCount = thread::hardware_concurrency() - 1;
+	else
+		this->threadCount = threadCount;
+	if (this->threadCount <= 0)
+		this->threadCount = 1;
+
+	for (int i = 0; i < inputCount; ++i)
+		this->inputNodes.push_back(InputGraphNode<T>(i));
+	for (int i = 0; i < outputCount; ++i)
+		this->outputNodes.push_back(OutputGraphNode<T>(i + inputCount));
+
+	nodeCount = inputCount + outputCount;
+	useCompiled = false;
+	compiledValid = false;
+	batchSize = 1;
+	tanhMode = TANH_EXACT;
+	nodeOrder = ORDER_ID;
+	dynamicScheduling = false;
+	eventDriven = false;
+	eventEpsilon = T(0);
+	pruning = false;
+	liveValid = false;
+	settling = false;
+	settleValid = false;
+	quantizeBits = 0;
+	quantizeRange = T(1);
+	quantizedValid = false;
+	liveCount = 0;
+	fedCount = 0;
+	pruneWarmSteps = 0;
+	random.seed(rand());
+}
+
+template <class T, class Activation, class Acc>
+EvolutionGNN<T, Activation, Acc>::EvolutionGNN(int threadCount) {
+	if (threadCount < 0)
+		this->threadCount = thread::hardware_concurrency() - 1;
+	else
+		this->threadCount = threadCount;
+	if (this->threadCount <= 0)
+		this->threadCount = 1;
+	nodeCount = 0;
+	useCompiled = false;
+	compiledValid = false;
+	batchSize = 1;
+	tanhMode = TANH_EXACT;
+	nodeOrder = ORDER_ID;
+	dynamicScheduling = false;
+	eventDriven = false;
+	eventEpsilon = T(0);
+	pruning = false;
+	liveValid = false;
+	settling = false;
+	settleValid = false;
+	quantizeBits = 0;
+	quantizeRange = T(1);
+	quantizedValid = false;
+	liveCount = 0;
+	fedCount = 0;
+	pruneWarmSteps = 0;
+	random.seed(rand());
+}
+
+template <class Activation, class T>
+T applyActivation(int id, T x) {
+	switch (id) {
+	case ACTIVATION_TANH: return TanhActivation::apply(x);
+	case ACTIVATION_HARD_TANH: return HardTanhActivation::apply(x);
+	case ACTIVATION_RELU: return ReLUActivation::apply(x);
+	case ACTIVATION_STEP: return StepActivation::apply(x);
+	case ACTIVATION_PIECEWISE_LINEAR: return PiecewiseLinearActivation::apply(x);
+	default: return Activation::apply(x);
+	}
+}
+
+template <class Activation, class T>
+void applyActivation(int id, T* values, int count, TanhMode mode) {
+	switch (id) {
+	case ACTIVATION_TANH: TanhActivation::apply(values, count, mode); break;
+	case ACTIVATION_HARD_TANH: HardTanhActivation::apply(values, count, mode); break;
+	case ACTIVATION_RELU: ReLUActivation::apply(values, count, mode); break;
+	case ACTIVATION_STEP: StepActivation::apply(values, count, mode); break;
+	case ACTIVATION_PIECEWISE_LINEAR: PiecewiseLinearActivation::apply(values, count, mode); break;
+	default: Activation::apply(values, count, mode); break;
+	}
+}
+
+//FastTanh must not be contracted into FMA, so every kernel rounds the same way
+#if defined(__clang__)
+#define T_EVOLUTIONGRAPHNN_NO_CONTRACT _Pragma("clang fp contract(off)")
+#else
+#define T_EVOLUTIONGRAPHNN_NO_CONTRACT
+#endif
+#if !defined(__clang__) && defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC optimize("fp-contract=off")
+#endif
+
+template <class T>
+T FastTanh::apply(T x) {
+	T_EVOLUTIONGRAPHNN_NO_CONTRACT
+	if (x < T(-clampValue))x = T(-clampValue);
+	if (x > T(clampValue))x = T(clampValue);
+	T x2 = x * x;
+
+	T p = x2 * T(alpha13) + T(alpha11);
+	p = x2 * p + T(alpha9);
+	p = x2 * p + T(alpha7);
+	p = x2 * p + T(alpha5);
+	p = x2 * p + T(alpha3);
+	p = x2 * p + T(alpha1);
+	p = x * p;
+
+	T q = x2 * T(beta6) + T(beta4);
+	q = x2 * q + T(beta2);
+	q = x2 * q + T(beta0);
+
+	return p / q;
+}
+
+template <class T>
+void FastTanh::apply(T* values, int count) {
+	for (int i = 0; i < count; ++i)
+		values[i] = apply(values[i]);
+}
+
+inline void FastTanh::apply(float* values, int count) {
+	static void (*kernel)(float*, int) = selectKernel();
+	kernel(values, count);
+}
+
+inline void FastTanh::applyScalar(float* values, int count) {
+	for (int i = 0; i < count; ++i)
+		values[i] = apply<float>(values[i]);
+}
+
+#ifdef T_EVOLUTIONGRAPHNN_X86
+
+//Same steps as apply(T x), one vector register at a time
+#define T_EVOLUTIONGRAPHNN_FASTTANH(VEC, WIDTH, LOAD, STORE, SET1, MUL, ADD, DIV, MIN, MAX)	\
+	T_EVOLUTIONGRAPHNN_NO_CONTRACT													\
+	int i = 0;																			\
+	for (; i + WIDTH <= count; i += WIDTH) {											\
+		VEC x = LOAD(values + i);														\
+		x = MIN(MAX(x, SET1(-clampValue)), SET1(clampValue));							\
+		VEC x2 = MUL(x, x);																\
+		VEC p = ADD(MUL(x2, SET1(alpha13)), SET1(alpha11));								\
+		p = ADD(MUL(x2, p), SET1(alpha9));												\
+		p = ADD(MUL(x2, p), SET1(alpha7));												\
+		p = ADD(MUL(x2, p), SET1(alpha5));												\
+		p = ADD(MUL(x2, p), SET1(alpha3));												\
+		p = ADD(MUL(x2, p), SET1(alpha1));												\
+		p = MUL(x, p);																	\
+		VEC q = ADD(MUL(x2, SET1(beta6)), SET1(beta4));									\
+		q = ADD(MUL(x2, q), SET1(beta2));												\
+		q = ADD(MUL(x2, q), SET1(beta0));												\
+		STORE(values + i, DIV(p, q));													\
+	}																					\
+	applyScalar(values + i, count - i);
+
+__attribute__((target("sse2"))) inline void FastTanh::applySSE(float* values, int count) {
+	T_EVOLUTIONGRAPHNN_FASTTANH(__m128, 4, _mm_loadu_ps, _mm_storeu_ps, _mm_set1_ps, _mm_mul_ps, _mm_add_ps, _mm_div_ps, _mm_min_ps, _mm_max_ps)
+}
+
+__attribute__((target("avx2"))) inline void FastTanh::applyAVX2(float* values, int count) {
+	T_EVOLUTIONGRAPHNN_FASTTANH(__m256, 8, _mm256_loadu_ps, _mm256_storeu_ps, _mm256_set1_ps, _mm256_mul_ps, _mm256_add_ps, _mm256_div_ps, _mm256_min_ps, _mm256_max_ps)
+}
+
+__attribute__((target("avx512f"))) inline void FastTanh::applyAVX512(float* values, int count) {
+	T_EVOLUTIONGRAPHNN_FASTTANH(__m512, 16, _mm512_loadu_ps, _mm512_storeu_ps, _mm512_set1_ps, _mm512_mul_ps, _mm512_add_ps, _mm512_div_ps, _mm512_min_ps, _mm512_max_ps)
+}
+
+#undef T_EVOLUTIONGRAPHNN_FASTTANH
+
+#endif
+
+#if !defined(__clang__) && defined(__GNUC__)
+#pragma GCC pop_options
+#endif
+
+inline void (*FastTanh::selectKernel())(float*, int) {
+#ifdef T_EVOLUTIONGRAPHNN_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f"))return &FastTanh::applyAVX512;
+	if (__builtin_cpu_supports("avx2"))return &FastTanh::applyAVX2;
+	if (__builtin_cpu_supports("sse2"))return &FastTanh::applySSE;
+#endif
+	return &FastTanh::applyScalar;
+}
+
+inline const char* FastTanh::getInstructionSet() {
+	void (*kernel)(float*, int) = selectKernel();
+#ifdef T_EVOLUTIONGRAPHNN_X86
+	if (kernel == &FastTanh::applyAVX512)return "AVX-512";
+	if (kernel == &FastTanh::applyAVX2)return "AVX2";
+	if (kernel == &FastTanh::applySSE)return "SSE";
+#endif
+	return "Scalar";
+}
+
+inline void EvoRandom::setState(const unsigned long long state[4]) {
+	for (int i = 0; i < 4; ++i)
+		this->state[i] = state[i];
+}
+
+inline void EvoRandom::getState(unsigned long long state[4]) {
+	for (int i = 0; i < 4; ++i)
+		state[i] = this->state[i];
+}
+
+inline EvoRandom EvoRandom::split() {
+	EvoRandom stream = *this;
+	jump();
+	return stream;
+}
+
+inline void EvoRandom::jump() {
+	static const unsigned long long JUMP[] = { 0x180ec6d33cfd0abaull, 0xd5a61266f0c9392cull, 0xa9582618e03fc9aaull, 0x39abdc4529b1661cull };
+
+	unsigned long long s[4] = { 0, 0, 0, 0 };
+	for (int i = 0; i < 4; ++i)
+		for (int b = 0; b < 64; ++b) {
+			if (JUMP[i] & 1ull << b)
+				for (int k = 0; k < 4; ++k)
+					s[k] ^= state[k];
+			next();
+		}
+	setState(s);
+}
+
+inline double EvoRandom::nextDouble() {
+	//Top 53 bits fill the mantissa
+	return (next() >> 11) * 0x1.0p-53;
+}
+
+inline int EvoRandom::nextInt(int n) {
+	//Multiply instead of modulo, n * [0, 2^32) / 2^32 is in [0, n)
+	return (next() >> 32) * (unsigned long long)n >> 32;
+}
+
+inline unsigned long long EvoRandom::next() {
+	unsigned long long result = state[1] * 5;
+	result = (result << 7 | result >> 57) * 9;
+
+	unsigned long long t = state[1] << 17;
+	state[2] ^= state[0];
+	state[3] ^= state[1];
+	state[1] ^= state[2];
+	state[0] ^= state[3];
+	state[2] ^= t;
+	state[3] = state[3] << 45 | state[3] >> 19;
+
+	return result;
+}
+
+inline void EvoRandom::seed(unsigned long long seed) {
+	//Expand the seed with splitmix64, which never gives an all zero state
+	for (int i = 0; i < 4; ++i) {
+		unsigned long long z = (seed += 0x9e3779b97f4a7c15ull);
+		z = (z ^ z >> 30) * 0xbf58476d1ce4e5b9ull;
+		z = (z ^ z >> 27) * 0x94d049bb133111ebull;
+		state[i] = z ^ z >> 31;
+	}
+}
+
+inline EvoRandom::EvoRandom(unsigned long long seed) {
+	this->seed(seed);
+}
+
+inline double PerfCounters::now() {
+	return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline void PerfCounters::closePhase(PerfPhase phase, int slot, int active, double end) {
+	//The first phase starts once every worker runs the job
+	if (mark < 0)
+		mark = *max_element(entered.begin(), entered.end());
+	double wall = end - mark;
+	phaseTime[phase] += wall;
+	mark = end;
+
+	double slowest = 0.0, total = 0.0;
+	for (int i = 0; i < phaseBusy[slot].size(); ++i) {
+		double busy = i < active ? phaseBusy[slot][i] : 0.0;
+		busyTime[i] += busy;
+		idleTime[i] += max(0.0, wall - busy);
+		slowest = max(slowest, busy);
+		total += busy;
+		phaseBusy[slot][i] = 0.0;
+	}
+
+	if (active > 1 && total > 0.0) {
+		double imbalance = slowest * active / total;
+		++balancedPhases;
+		imbalanceSum += imbalance;
+		imbalanceMax = max(imbalanceMax, imbalance);
+	}
+}
+
+inline PerfCounters::PerfCounters() {
+	reset();
+}
+
+inline void PerfCounters::reset() {
+	steps = edges = balancedPhases = 0;
+	for (int i = 0; i < PHASE_COUNT; ++i)
+		phaseTime[i] = 0.0;
+	busyTime.clear();
+	idleTime.clear();
+	imbalanceSum = imbalanceMax = 0.0;
+	jobStart = 0.0;
+	mark = -1.0;
+}
+
+inline long long PerfCounters::getSteps() {
+	return steps;
+}
+
+inline long long PerfCounters::getEdges() {
+	return edges;
+}
+
+inline double PerfCounters::getPhaseTime(PerfPhase phase) {
+	return phaseTime[phase];
+}
+
+inline int PerfCounters::getWorkerCount() {
+	return busyTime.size();
+}
+
+inline double PerfCounters::getBusyTime(int worker) {
+	return worker >= 0 && worker < busyTime.size() ? busyTime[worker] : 0.0;
+}
+
+inline double PerfCounters::getIdleTime(int worker) {
+	return worker >= 0 && worker < idleTime.size() ? idleTime[worker] : 0.0;
+}
+
+inline double PerfCounters::getImbalance() {
+	return balancedPhases ? imbalanceSum / balancedPhases : 0.0;
+}
+
+inline double PerfCounters::getMaxImbalance() {
+	return imbalanceMax;
+}
+
+inline string PerfCounters::summary() {
+	const char* names[PHASE_COUNT] = { "dispatch", "run", "flip", "join" };
+	double total = 0.0;
+	for (int i = 0; i < PHASE_COUNT; ++i)
+		total += phaseTime[i];
+
+	stringstream out;
+	out << fixed << setprecision(6);
+	out << "Steps:\t" << steps << endl;
+	out << "Edges:\t" << edges;
+	if (total > 0.0)out << "\t(" << setprecision(0) << edges / total << " edges/s)" << setprecision(6);
+	out << endl;
+	for (int i = 0; i < PHASE_COUNT; ++i) {
+		out << "Phase " << names[i] << ":\t" << phaseTime[i] << " s";
+		if (total > 0.0)out << "\t" << setprecision(1) << 100.0 * phaseTime[i] / total << "%" << setprecision(6);
+		out << endl;
+	}
+	for (int i = 0; i < busyTime.size(); ++i)
+		out << "Worker " << i << ":\tbusy " << busyTime[i] << " s\tidle " << idleTime[i] << " s" << endl;
+	out << setprecision(3);
+	out << "Imbalance:\t" << getImbalance() << " average, " << imbalanceMax << " max over " << balancedPhases << " phases" << endl;
+	return out.str();
+}
+
+inline void PerfCounters::addSteps(long long count, long long edges) {
+#ifdef T_EVOLUTIONGRAPHNN_PERF_COUNTERS
+	steps += count;
+	this->edges += count * edges;
+#else
+	(void)count;
+	(void)edges;
+#endif
+}
+
+template <class Work>
+void PerfCounters::timeSerial(PerfPhase phase, const Work& work) {
+#ifdef T_EVOLUTIONGRAPHNN_PERF_COUNTERS
+	double start = now();
+	work();
+	double wall = now() - start;
+	phaseTime[phase] += wall;
+	if (busyTime.empty()) {
+		busyTime.resize(1, 0.0);
+		idleTime.resize(1, 0.0);
+	}
+	busyTime[0] += wall;
+#else
+	(void)phase;
+	work();
+#endif
+}
+
+inline void PerfCounters::beginJob(int workers) {
+#ifdef T_EVOLUTIONGRAPHNN_PERF_COUNTERS
+	if (busyTime.size() < workers) {
+		busyTime.resize(workers, 0.0);
+		idleTime.resize(workers, 0.0);
+	}
+	for (int slot = 0; slot < 2; ++slot)
+		phaseBusy[slot].assign(workers, 0.0);
+	entered.assign(workers, 0.0);
+	left.assign(workers, 0.0);
+	mark = -1.0;
+	jobStart = now();
+#else
+	(void)workers;
+#endif
+}
+
+inline void PerfCounters::enterJob(int id) {
+#ifdef T_EVOLUTIONGRAPHNN_PERF_COUNTERS
+	entered[id] = now();
+#else
+	(void)id;
+#endif
+}
+
+inline void PerfCounters::leaveJob(int id) {
+#ifdef T_EVOLUTIONGRAPHNN_PERF_COUNTERS
+	left[id] = now();
+#else
+	(void)id;
+#endif
+}
+
+template <class Work>
+void PerfCounters::timeWork(int id, int slot, const Work& work) {
+#ifdef T_EVOLUTIONGRAPHNN_PERF_COUNTERS
+	double start = now();
+	work();
+	phaseBusy[slot][id] += now() - start;
+#else
+	(void)id;
+	(void)slot;
+	work();
+#endif
+}
+
+inline void PerfCounters::endPhase(PerfPhase phase, int slot, int active) {
+#ifdef T_EVOLUTIONGRAPHNN_PERF_COUNTERS
+	closePhase(phase, slot, active, now());
+#else
+	(void)phase;
+	(void)slot;
+	(void)active;
+#endif
+}
+
+inline void PerfCounters::endJob(PerfPhase phase, int slot, int active) {
+#ifdef T_EVOLUTIONGRAPHNN_PERF_COUNTERS
+	double end = now();
+	double lastEntered = *max_element(entered.begin(), entered.end());
+	double lastLeft = *max_element(left.begin(), left.end());
+	if (phase != PHASE_COUNT)
+		closePhase(phase, slot, active, lastLeft);
+	phaseTime[PHASE_DISPATCH] += lastEntered - jobStart;
+	phaseTime[PHASE_JOIN] += end - lastLeft;
+#else
+	(void)phase;
+	(void)slot;
+	(void)active;
+#endif
+}
+
+inline int findComponents(int count, const vector<int>& offsets, const vector<int>& targets, vector<int>& component) {
+	//Tarjan's algorithm with an explicit path, so long chains do not overflow the stack
+	vector<int> index(count, -1), low(count, 0), edge(count, 0);
+	vector<int> path, stack;
+	vector<char> onStack(count, 0);
+	int visited = 0, found = 0;
+	component.assign(count, -1);
+
+	for (int root = 0; root < count; ++root) {
+		if (index[root] >= 0)continue;
+		index[root] = low[root] = visited++;
+		edge[root] = offsets[root];
+		path.push_back(root);
+		stack.push_back(root);
+		onStack[root] = 1;
+
+		while (!path.empty()) {
+			int v = path.back();
+			if (edge[v] < offsets[v + 1]) {
+				int w = targets[edge[v]++];
+				if (index[w] < 0) {
+					index[w] = low[w] = visited++;
+					edge[w] = offsets[w];
+					path.push_back(w);
+					stack.push_back(w);
+					onStack[w] = 1;
+				}
+				else if (onStack[w])
+					low[v] = min(low[v], index[w]);
+				continue;
+			}
+
+			//Every successor is done, v is the first vertex of a component unless it reaches further back
+			path.pop_back();
+			if (!path.empty())
+				low[path.back()] = min(low[path.back()], low[v]);
+			if (low[v] != index[v])continue;
+
+			int w;
+			do {
+				w = stack.back();
+				stack.pop_back();
+				onStack[w] = 0;
+				component[w] = found;
+			} while (w != v);
+			++found;
+		}
+	}
+
+	//A component is closed after every component it reaches, so topological order is the reverse
+	for (int v = 0; v < count; ++v)
+		component[v] = found - 1 - component[v];
+	return found;
+}
+
+inline void WorkerPool::parallelFor(int count, const function<void(int, int)>& task) {
+	if (count <= 0)return;
+
+	execute([&](int id, int workers) {
+		//Every worker takes an equal slice inside the job, so another caller waiting
+		//for the pool cannot overwrite ranges, and no slice is stolen before it is set
+		unsigned long long begin = 1ll * count * id / workers;
+		unsigned long long end = 1ll * count * (id + 1) / workers;
+		ranges[id].store(begin << 32 | end);
+		wait();
+
+		int index;
+		bool stolen;
+		do {
+			while (popTask(id, index))
+				task(index, id);
+
+			//Own slice is done, take work from others until nothing is left
+			stolen = false;
+			for (int i = 1; i < workers && !stolen; ++i)
+				stolen = stealTasks((id + i) % workers, id);
+		} while (stolen);
+	});
+}
+
+inline bool WorkerPool::stealTasks(int victim, int thief) {
+	unsigned long long range = ranges[victim].load();
+	while (true) {
+		unsigned long long begin = range >> 32, end = range & 0xffffffffull;
+
+		//A single task is left to its owner
+		if (end < begin + 2)return false;
+
+		unsigned long long half = (end - begin) / 2;
+		if (ranges[victim].compare_exchange_weak(range, begin << 32 | (end - half))) {
+			ranges[thief].store((end - half) << 32 | end);
+			return true;
+		}
+	}
+}
+
+inline bool WorkerPool::popTask(int id, int& index) {
+	unsigned long long range = ranges[id].load();
+	while (true) {
+		unsigned long long begin = range >> 32, end = range & 0xffffffffull;
+		if (begin >= end)return false;
+
+		if (ranges[id].compare_exchange_weak(range, (begin + 1) << 32 | end)) {
+			index = begin;
+			return true;
+		}
+	}
+}
+
+inline void WorkerPool::wait() {
+	sync->arrive_and_wait();
+}
+
+inline void WorkerPool::execute(const function<void(int, int)>& job) {
+	lock_guard<mutex> guard(executing);
+
+	this->job = &job;
+
+	//Release parked workers
+	sync->arrive_and_wait();
+
+	job(0, workerCount);
+
+	//Wait for all workers to finish
+	sync->arrive_and_wait();
+	this->job = nullptr;
+}
+
+inline int WorkerPool::getWorkerCount() {
+	return workerCount;
+}
+
+inline void WorkerPool::work(int id) {
+	while (true) {
+		//Park until a job is given
+		sync->arrive_and_wait();
+		if (stopping)break;
+
+		(*job)(id, workerCount);
+
+		//Job finished
+		sync->arrive_and_wait();
+	}
+}
+
+inline WorkerPool::~WorkerPool() {
+	stopping = true;
+	sync->arrive_and_wait();
+	for (int i = 0; i < workers.size(); ++i)
+		workers[i].join();
+}
+
+inline WorkerPool::WorkerPool(int workerCount) {
+	if (workerCount <= 0)workerCount = 1;
+	this->workerCount = workerCount;
+	this->job = nullptr;
+	this->stopping = false;
+	this->sync = make_unique<barrier<>>(workerCount);
+	this->ranges = make_unique<atomic<unsigned long long>[]>(workerCount);
+
+	for (int i = 1; i < workerCount; ++i)
+		workers.push_back(thread(&WorkerPool::work, this, i));
+}
+
+template <class T, class Activation, class Acc>
+bool CompiledGraph<T, Activation, Acc>::isMapped() {
+	return sources.isView();
+}
+
+template <class T, class Activation, class Acc>
+bool CompiledGraph<T, Activation, Acc>::map(const string& path) {
+	clear();
+
+	shared_ptr<MappedFile> file = make_shared<MappedFile>();
+	if (!file->open(path) || file->getSize() < sizeof(ModelHeader))return false;
+
+	char* data = file->getData();
+	ModelHeader header;
+	memcpy(&header, data, sizeof(ModelHeader));
+	if (!header.template check<T, Acc>(data, file->getSize()))return false;
+
+	inputCount = header.inputCount;
+	outputCount = header.outputCount;
+	nodeCount = header.getNodeSize();
+	liveCount = header.connectionCount;
+	int slots = header.slotCount;
+
+	//Connection arrays stay in the file
+	rowOffsets.view(reinterpret_cast<int*>(data + header.offsets[SECTION_ROW_OFFSETS]), nodeCount + 1);
+	rowEnds.view(reinterpret_cast<int*>(data + header.offsets[SECTION_ROW_ENDS]), nodeCount);
+	sources.view(reinterpret_cast<int*>(data + header.offsets[SECTION_SOURCES]), slots);
+	weights.view(reinterpret_cast<T*>(data + header.offsets[SECTION_WEIGHTS]), slots);
+	buffers[0].view(reinterpret_cast<T*>(data + header.offsets[SECTION_READ]), slots);
+	buffers[1].view(reinterpret_cast<T*>(data + header.offsets[SECTION_WRITE]), slots);
+	bufferState.view(data + header.offsets[SECTION_STATES], slots);
+	connections.view(reinterpret_cast<ConnectionHandle*>(data + header.offsets[SECTION_INDICES]), slots);
+
+	//Node arrays are small, and copied
+	const int* placed = reinterpret_cast<const int*>(data + header.offsets[SECTION_ORDER]);
+	order.assign(placed, placed + nodeCount);
+	position.resize(nodeCount);
+	for (int p = 0; p < nodeCount; ++p)
+		position[order[p]] = p;
+
+	values = header.template getValues<T, Acc>(data);
+
+	const unsigned char* ids = reinterpret_cast<const unsigned char*>(data + header.offsets[SECTION_ACTIVATIONS]);
+	groupActivations(vector<unsigned char>(ids, ids + nodeCount));
+
+	mapping = file;
+	return true;
+}
+
+template <class T, class Activation, class Acc>
+void CompiledGraph<T, Activation, Acc>::save(ConnectionPool<T>& pool, fstream& out, const vector<unsigned char>& activations, int version) {
+	int slots = sources.size();
+
+	ModelHeader header;
+	header.template initialize<T, Acc>(version);
+	header.inputCount = inputCount;
+	header.outputCount = outputCount;
+	header.hiddenCount = nodeCount - inputCount - outputCount;
+	header.connectionCount = liveCount;
+	header.slotCount = slots;
+	header.layout();
+
+	//Buffers of lane 0 relative to the next run, so the file starts with parity 0
+	vector<T> read(slots, T(0)), write(slots, T(0));
+	vector<char> states(slots, 0);
+	vector<int> indices(slots, -1);
+	for (int i = 0; i < slots; ++i) {
+		if (sources[i] < 0)continue;
+		read[i] = buffers[parity][i * lanes];
+		write[i] = buffers[!parity][i * lanes];
+		states[i] = bufferState[i] != flipped;
+		indices[i] = pool[connections[i]].getIndex();
 	}
 
-	friend ostream;
-};
+	vector<Acc> value(nodeCount);
+	vector<T> rounded(version >= 3 ? 0 : nodeCount);
+	for (int p = 0; p < nodeCount; ++p)
+		value[p] = values[p * lanes];
+	for (int p = 0; p < rounded.size(); ++p)
+		rounded[p] = T(value[p]);
+
+	vector<unsigned char> ids(nodeCount, ACTIVATION_DEFAULT);
+	for (int i = 0; i < activations.size() && i < nodeCount; ++i)
+		ids[i] = activations[i];
+
+	out.write(reinterpret_cast<char*>(&header), sizeof(ModelHeader));
+
+	//Pad to the offset of each section, then write it
+	long long written = sizeof(ModelHeader);
+	auto section = [&](int s, const void* bytes) {
+		static const char zeros[MODEL_ALIGNMENT] = { 0 };
+		out.write(zeros, header.offsets[s] - written);
+		out.write(reinterpret_cast<const char*>(bytes), header.getSectionSize(s));
+		written = header.offsets[s] + header.getSectionSize(s);
+	};
+	section(SECTION_ROW_OFFSETS, rowOffsets.data());
+	section(SECTION_ROW_ENDS, rowEnds.data());
+	section(SECTION_SOURCES, sources.data());
+	section(SECTION_WEIGHTS, weights.data());
+	section(SECTION_READ, read.data());
+	section(SECTION_WRITE, write.data());
+	section(SECTION_STATES, states.data());
+	section(SECTION_INDICES, indices.data());
+	section(SECTION_ORDER, order.data());
+	section(SECTION_VALUES, version >= 3 ? (const void*)value.data() : (const void*)rounded.data());
+	section(SECTION_ACTIVATIONS, ids.data());
+}
 
-//Show info of a EvolutionGNN
-template <class T>
-ostream& operator<<(ostream& o, EvolutionGNN<T>& egnn) {
-	o << "Evolution Graph Neural Network" << endl;
-	o << "\tInput Nodes:\t" << egnn.getInputSize() << endl;
-	o << "\tHidden Nodes:\t" << egnn.getHiddenSize() << endl;
-	o << "\tOutput Nodes:\t" << egnn.getOutputSize() << endl;
-	o << "\tConnections:\t" << egnn.getConnectionSize();
-	return o;
+template <class T, class Activation, class Acc>
+void CompiledGraph<T, Activation, Acc>::writeBack(ConnectionPool<T>& pool) {
+	for (int i = 0; i < connections.size(); ++i) {
+		if (sources[i] < 0)continue;
+
+		//Every flip since compile toggled the logical buffer state
+		bool state = bufferState[i] != flipped;
+		T read = buffers[parity][i * lanes];
+		T write = buffers[!parity][i * lanes];
+
+		Connection<T>& c = pool[connections[i]];
+		c.setABuffer(state ? write : read);
+		c.setBBuffer(state ? read : write);
+		c.setBufferState(state);
+	}
+}
+
+template <class T, class Activation, class Acc>
+void CompiledGraph<T, Activation, Acc>::flipBuffer() {
+	parity = !parity;
+	flipped = !flipped;
 }
 
+template <class T, class Activation, class Acc>
+bool CompiledGraph<T, Activation, Acc>::getParity() {
+	return parity;
+}
 
+template <class T, class Activation, class Acc>
+void CompiledGraph<T, Activation, Acc>::writeConnections(int start, int end, bool parity) {
+	const int* src = sources.data();
+	const Acc* value = values.data();
+	T* write = buffers[!parity].data();
 
+	if (lanes == 1) {
+		for (int i = start; i < end; ++i) {
+			int s = src[i];
 
-/***********************************************/
-// Function bodies
+			//Output nodes never write to their out-going connections
+			//Free slots have no inNode
+			if (s < 0 || (s >= inputCount && s < inputCount + outputCount))continue;
 
-template <class T>
-void EvolutionGNN<T>::saveDOT(string filename) {
-	fstream file;
-	file.open(filename, ios::out);
-	file << getDOT();
-	file.close();
+			write[i] = T(value[s]);
+		}
+		return;
+	}
+
+	for (int i = start; i < end; ++i) {
+		int s = src[i];
+		if (s < 0 || (s >= inputCount && s < inputCount + outputCount))continue;
+
+		T* w = write + i * lanes;
+		const Acc* v = value + s * lanes;
+		for (int b = 0; b < lanes; ++b)
+			w[b] = T(v[b]);
+	}
 }
 
-template <class T>
-string EvolutionGNN<T>::getDOT() {
-	string dot;
+template <class T, class Activation, class Acc>
+void CompiledGraph<T, Activation, Acc>::runNodes(int startId, int endId, bool parity) {
+	const int* offsets = rowOffsets.data();
+	const int* ends = rowEnds.data();
+	const T* w = weights.data();
+	const T* read = buffers[parity].data();
+	Acc* value = values.data();
+
+	//Input nodes keep their input values
+	if (startId < inputCount)startId = inputCount;
+
+	if (startId >= endId)return;
+
+	if (lanes == 1) {
+		for (int n = startId; n < endId; ++n) {
+			Acc sum = Acc(0);
+			for (int i = offsets[n]; i < ends[n]; ++i)
+				sum += Acc(w[i]) * Acc(read[i]);
+			value[n] = sum;
+		}
+	}
+	else {
+		//Sum up all lanes of a node together, each lane in the same order as a single run
+		vector<Acc> sum(lanes);
+		for (int n = startId; n < endId; ++n) {
+			for (int b = 0; b < lanes; ++b)
+				sum[b] = Acc(0);
+			for (int i = offsets[n]; i < ends[n]; ++i) {
+				Acc weight = Acc(w[i]);
+				const T* r = read + i * lanes;
+				for (int b = 0; b < lanes; ++b)
+					sum[b] += weight * Acc(r[b]);
+			}
+
+			Acc* v = value + n * lanes;
+			for (int b = 0; b < lanes; ++b)
+				v[b] = sum[b];
+		}
+	}
 
-	//Syntex
-	dot += "digraph Evolutional_Graph_Neural_Network {\n";
-	dot += "\trankdir=TB;\n";
-	dot += "\tnode [shape = circle];\n";
+	activate(startId, endId);
+}
 
-	//All input nodes
-	dot += "\tsubgraph cluster_0 {\n";
-	dot += "\t\tlabel=\"Input Nodes\";\n";
-	for (int i = 0; i < inputNodes.size(); ++i)
-		dot += "\t\t" + to_string(i) + "; ";
-	dot += "\n\t}\n";
+template <class T, class Activation, class Acc>
+void CompiledGraph<T, Activation, Acc>::activate(int startId, int endId) {
+	Acc* value = values.data();
 
-	//All output nodes
-	dot += '\n';
-	dot += "\tsubgraph cluster_1 {\n";
-	dot += "\t\tlabel=\"Output Nodes\";\n";
-	int s = inputNodes.size();
-	for (int i = 0; i < outputNodes.size(); ++i)
-		dot += "\t\t" + to_string(i + s) + "; ";
-	dot += "\n\t}\n\n";
+	//Activation function over the whole block
+	if (activationGroups.empty()) {
+		Activation::apply(value + startId * lanes, (endId - startId) * lanes, tanhMode);
+		return;
+	}
 
-	////Uncomment to show disconnected nodes
-	////All hidden nodes
-	//dot += '\t';
-	//s = inputNodes.size() + outputNodes.size();
-	//for(int i = 0; i < graphNodes.size(); ++i)
-	//	dot += to_string(i + s) + "; ";
-	//dot += "\n\n";
+	//Gather each group into a block, activate it and scatter it back,
+	//so the activation is only picked once per group
+	vector<Acc> block;
+	for (int a = 0; a < activationGroups.size(); ++a) {
+		vector<int>& group = activationGroups[a];
+		auto first = lower_bound(group.begin(), group.end(), startId);
+		auto last = lower_bound(first, group.end(), endId);
+		if (first == last)continue;
+
+		block.resize((last - first) * lanes);
+		Acc* b = block.data();
+		for (auto n = first; n != last; ++n)
+			for (int l = 0; l < lanes; ++l)
+				*b++ = value[*n * lanes + l];
+
+		applyActivation<Activation>(a, block.data(), block.size(), tanhMode);
+
+		b = block.data();
+		for (auto n = first; n != last; ++n)
+			for (int l = 0; l < lanes; ++l)
+				value[*n * lanes + l] = *b++;
+	}
+}
 
+template <class T, class Activation, class Acc>
+void CompiledGraph<T, Activation, Acc>::activate(const vector<int>& list) {
+	//Gather values into a block per activation, like activate() over a range
+	vector<Acc> block;
+	int groups = activationGroups.empty() ? 1 : activationGroups.size();
+	for (int a = 0; a < groups; ++a) {
+		block.clear();
+		for (int p : list)
+			if (activationGroups.empty() || groupOf[p] == a)
+				block.push_back(values[p]);
+		if (block.empty())continue;
+
+		if (activationGroups.empty())
+			Activation::apply(block.data(), block.size(), tanhMode);
+		else
+			applyActivation<Activation>(a, block.data(), block.size(), tanhMode);
 
-	//All connections (edges)
-	for (auto i : con)
-		dot += '\t' + i->getDOT() + '\n';
+		Acc* b = block.data();
+		for (int p : list)
+			if (activationGroups.empty() || groupOf[p] == a)
+				values[p] = *b++;
+	}
+}
 
-	//Syntex
-	dot += "}\n";
+template <class T, class Activation, class Acc>
+void CompiledGraph<T, Activation, Acc>::prepareEvents() {
+	int slots = sources.size();
+	const int* src = sources.data();
+
+	//Slots grouped by the position writing them
+	outOffsets.assign(nodeCount + 1, 0);
+	for (int i = 0; i < slots; ++i)
+		if (src[i] >= 0)++outOffsets[src[i] + 1];
+	for (int p = 0; p < nodeCount; ++p)
+		outOffsets[p + 1] += outOffsets[p];
+	outSlots.resize(outOffsets[nodeCount]);
+	vector<int> cursor(outOffsets.begin(), outOffsets.end() - 1);
+	for (int i = 0; i < slots; ++i)
+		if (src[i] >= 0)outSlots[cursor[src[i]]++] = i;
+
+	//Output nodes never write their slots, so both buffers keep their compiled states
+	//and nodes reading them can change every step
+	slotRows.assign(slots, -1);
+	alwaysActive.clear();
+	for (int p = inputCount; p < nodeCount; ++p) {
+		bool readsOutput = false;
+		for (int i = rowOffsets[p]; i < rowEnds[p]; ++i) {
+			slotRows[i] = p;
+			if (src[i] >= inputCount && src[i] < inputCount + outputCount)readsOutput = true;
+		}
+		if (readsOutput)alwaysActive.push_back(p);
+	}
 
-	return dot;
+	groupOf.assign(nodeCount, 0);
+	for (int a = 0; a < activationGroups.size(); ++a)
+		for (int p : activationGroups[a])
+			groupOf[p] = a;
+
+	propagated.assign(values.begin(), values.begin() + nodeCount);
+	stamp.assign(nodeCount, 0);
+	eventStep = 0;
+	changed.clear();
+	previous.clear();
+
+	//Buffers hold states from before, not values of their sources, until every
+	//connection was written once on both sides
+	warmSteps = 2;
+	eventsReady = true;
 }
 
-template <class T>
-void EvolutionGNN<T>::mutate(double newConRate, double deleteConRate, double newNodeRate, double repeatRate) {
-	do {
-		//Create a new connection
-		if (rand() % 10000 / 10000.0 < newConRate)
-			addRandomConnection();
+template <class T, class Activation, class Acc>
+long long CompiledGraph<T, Activation, Acc>::runEvents(bool parity) {
+	if (!eventsReady)prepareEvents();
+
+	const int* offsets = rowOffsets.data();
+	const int* ends = rowEnds.data();
+	const T* w = weights.data();
+	const T* read = buffers[parity].data();
+	T* write = buffers[!parity].data();
+	Acc* value = values.data();
+
+	auto moved = [&](int p) {
+		Acc d = value[p] - propagated[p];
+		return !(d <= epsilon && d >= -epsilon);
+	};
+	auto isOutput = [&](int p) {
+		return p >= inputCount && p < inputCount + outputCount;
+	};
+
+	long long edges = liveCount;
+	changed.clear();
+	if (warmSteps > 0) {
+		--warmSteps;
+		runNodes(0, nodeCount, parity);
+		writeConnections(0, sources.size(), parity);
+
+		active.resize(nodeCount);
+		for (int p = 0; p < nodeCount; ++p) {
+			active[p] = p;
+			if (!isOutput(p) && moved(p)) {
+				changed.push_back(p);
+				propagated[p] = value[p];
+			}
+		}
+		previous.swap(changed);
+		return edges;
+	}
 
-		//Delete a connection
-		if (rand() % 10000 / 10000.0 < deleteConRate)
-			if (con.size() > 0)
-				removeConnection(rand() % con.size());
+	//Inputs set since the last step
+	for (int p = 0; p < inputCount; ++p)
+		if (moved(p)) {
+			changed.push_back(p);
+			propagated[p] = value[p];
+		}
 
-		//Create a new node
-		if (rand() % 10000 / 10000.0 < newNodeRate)
-			addNodes();
+	//Nodes reading a value written in the previous step, each added once
+	if (++eventStep == 0) {
+		stamp.assign(nodeCount, 0);
+		eventStep = 1;
+	}
+	active.clear();
+	auto add = [&](int p) {
+		if (p < inputCount || stamp[p] == eventStep)return;
+		stamp[p] = eventStep;
+		active.push_back(p);
+	};
+	for (int p : alwaysActive)
+		add(p);
+	for (int s : previous)
+		for (int k = outOffsets[s]; k < outOffsets[s + 1]; ++k)
+			add(slotRows[outSlots[k]]);
+
+	//Same sums as runNodes(), in the same order
+	edges = 0;
+	for (int p : active) {
+		Acc sum = Acc(0);
+		for (int i = offsets[p]; i < ends[p]; ++i)
+			sum += Acc(w[i]) * Acc(read[i]);
+		value[p] = sum;
+		edges += ends[p] - offsets[p];
+	}
+	activate(active);
+
+	for (int p : active)
+		if (!isOutput(p) && moved(p)) {
+			changed.push_back(p);
+			propagated[p] = value[p];
+		}
+
+	//Slots of nodes unchanged for two steps already hold their value on both sides
+	for (vector<int>* list : { &changed, &previous })
+		for (int s : *list)
+			for (int k = outOffsets[s]; k < outOffsets[s + 1]; ++k)
+				write[outSlots[k]] = T(value[s]);
 
-	} while (rand() % 10000 / 10000.0 < repeatRate);	//Mutate once more
+	previous.swap(changed);
+	return edges;
 }
 
-template <class T>
-void EvolutionGNN<T>::inherit(EvolutionGNN<T>& parentA, EvolutionGNN<T>& parentB, double AConRate, double BConRate, bool inheritMemory) {
+template <class T, class Activation, class Acc>
+void CompiledGraph<T, Activation, Acc>::prepareSettle() {
+	int slots = sources.size();
+	const int* src = sources.data();
+	auto isOutput = [&](int p) {
+		return p >= inputCount && p < inputCount + outputCount;
+	};
+
+	//Successors of each position, input nodes read nothing and output nodes write nothing
+	vector<int> offsets(nodeCount + 1, 0), targets;
+	for (int p = inputCount; p < nodeCount; ++p)
+		for (int i = rowOffsets[p]; i < rowEnds[p]; ++i)
+			if (!isOutput(src[i]))++offsets[src[i] + 1];
+	for (int p = 0; p < nodeCount; ++p)
+		offsets[p + 1] += offsets[p];
+	targets.resize(offsets[nodeCount]);
+	vector<int> cursor(offsets.begin(), offsets.end() - 1);
+	for (int p = inputCount; p < nodeCount; ++p)
+		for (int i = rowOffsets[p]; i < rowEnds[p]; ++i)
+			if (!isOutput(src[i]))targets[cursor[src[i]]++] = p;
+
+	vector<int> component;
+	int components = findComponents(nodeCount, offsets, targets, component);
+
+	//Counting sort of positions by component
+	vector<int> first(components + 1, 0);
+	for (int p = 0; p < nodeCount; ++p)
+		++first[component[p] + 1];
+	for (int c = 0; c < components; ++c)
+		first[c + 1] += first[c];
+	settleOrder.resize(nodeCount);
+	for (int p = 0; p < nodeCount; ++p)
+		settleOrder[first[component[p]]++] = p;
+
+	crossSlot.assign(slots, 0);
+	for (int p = inputCount; p < nodeCount; ++p)
+		for (int i = rowOffsets[p]; i < rowEnds[p]; ++i)
+			crossSlot[i] = !isOutput(src[i]) && component[src[i]] != component[p];
+
+	settleReady = true;
+}
 
-	//Check required number of nodes
-	int inNodeCount = parentA.inputNodes.size();
-	int outNodeCount = parentA.outputNodes.size();
-	int hiddenNodeCount = parentA.graphNodes.size();
-	if (parentB.inputNodes.size() > inNodeCount)inNodeCount = parentB.inputNodes.size();
-	if (parentB.outputNodes.size() > outNodeCount)outNodeCount = parentB.outputNodes.size();
-	if (parentB.graphNodes.size() > hiddenNodeCount)hiddenNodeCount = parentB.graphNodes.size();
+template <class T, class Activation, class Acc>
+void CompiledGraph<T, Activation, Acc>::runSettled(bool parity) {
+	if (!settleReady)prepareSettle();
+
+	const int* offsets = rowOffsets.data();
+	const int* ends = rowEnds.data();
+	const int* src = sources.data();
+	const T* w = weights.data();
+	const T* read = buffers[parity].data();
+	Acc* value = values.data();
+
+	//Same sums as runNodes(), in the same order
+	vector<Acc> sum(lanes);
+	for (int p : settleOrder) {
+		if (p < inputCount)continue;
+
+		for (int b = 0; b < lanes; ++b)
+			sum[b] = Acc(0);
+		for (int i = offsets[p]; i < ends[p]; ++i) {
+			Acc weight = Acc(w[i]);
+			if (crossSlot[i]) {
+				//Rounded to T like the connection graph mode reads
+				const Acc* r = value + src[i] * lanes;
+				for (int b = 0; b < lanes; ++b)
+					sum[b] += weight * Acc(T(r[b]));
+			}
+			else {
+				const T* r = read + i * lanes;
+				for (int b = 0; b < lanes; ++b)
+					sum[b] += weight * Acc(r[b]);
+			}
+		}
 
-	//Create all nodes
-	initialize(inNodeCount, outNodeCount, threadCount);
-	addNodes(hiddenNodeCount);
+		Acc* v = value + p * lanes;
+		for (int b = 0; b < lanes; ++b)
+			v[b] = sum[b];
+		activate(p, p + 1);
+	}
 
-	//Selectively add connections from parents
-	//Note that if we also add buffer related info(values, states) to the child,
-	//"memory" will be passed to the child
-	for (auto i : parentA.con)
-		if ((rand() % 1000) / 1000.0 < AConRate)
-			if (inheritMemory)
-				addConnection(i->getInNodeId(), i->getOutNodeId(), i->getWeight(), i->getABuffer(), i->getBBuffer(), i->getBufferState());
-			else
-				addConnection(i->getInNodeId(), i->getOutNodeId(), i->getWeight());
+	writeConnections(0, sources.size(), parity);
+}
 
-	for (auto i : parentB.con)
-		if ((rand() % 1000) / 1000.0 < BConRate)
-			if (inheritMemory)
-				addConnection(i->getInNodeId(), i->getOutNodeId(), i->getWeight(), i->getABuffer(), i->getBBuffer(), i->getBufferState());
-			else
-				addConnection(i->getInNodeId(), i->getOutNodeId(), i->getWeight());
+template <class T, class Activation, class Acc>
+void CompiledGraph<T, Activation, Acc>::setSettling(bool enabled) {
+	settling = enabled;
+	settleReady = false;
+}
 
+template <class T, class Activation, class Acc>
+bool CompiledGraph<T, Activation, Acc>::isSettling() {
+	return settling;
 }
 
-template <class T>
-bool EvolutionGNN<T>::load(string path) {
+template <class T, class Activation, class Acc>
+void CompiledGraph<T, Activation, Acc>::setEventDriven(bool enabled, T epsilon) {
+	eventDriven = enabled;
+	this->epsilon = Acc(epsilon < T(0) ? -epsilon : epsilon);
+	eventsReady = false;
+}
 
-	fstream in;
-	in.open(path, ios::in | ios::binary);
+template <class T, class Activation, class Acc>
+bool CompiledGraph<T, Activation, Acc>::isEventDriven() {
+	return eventDriven;
+}
 
-	//Check if file open succeed
-	if (!in.is_open())return false;
+template <class T, class Activation, class Acc>
+int CompiledGraph<T, Activation, Acc>::getActiveSize() {
+	return active.size();
+}
 
-	char str[32] = { 0 };
-	in.read(str, 11);
-	//cout << "Read: " << str << endl;
-	//Check if keyword correct
-	if (strcmp(str, "InputNodes=")) {
-		//Error
-		in.close();
-		//cout << "Wrong keyword." << endl;
-		return false;
-	}
+template <class T, class Activation, class Acc>
+void CompiledGraph<T, Activation, Acc>::setTanhMode(TanhMode mode) {
+	tanhMode = mode;
+}
 
-	//Get InputNodes
-	int inputNodes;
-	in >> inputNodes;
+template <class T, class Activation, class Acc>
+void CompiledGraph<T, Activation, Acc>::setValue(int id, T val, int lane) {
+	values[position[id] * lanes + lane] = Acc(val);
+}
 
-	//cout << "InputNodes=" << inputNodes << endl;
-	if (inputNodes < 0) {
-		//Error
-		in.close();
-		//cout << "Wrong inputNodes." << endl;
-		return false;
-	}
+template <class T, class Activation, class Acc>
+T CompiledGraph<T, Activation, Acc>::getValue(int id, int lane) {
+	return T(values[position[id] * lanes + lane]);
+}
 
+template <class T, class Activation, class Acc>
+int CompiledGraph<T, Activation, Acc>::getLaneSize() {
+	return lanes;
+}
 
-	in.read(str, 13);
-	//cout << "Read: " << str << endl;//Check if keyword correct
-	if (strcmp(str, "\nHiddenNodes=")) {
-		//Error
-		in.close();
-		//cout << "Wrong keyword." << endl;
-		return false;
+template <class T, class Activation, class Acc>
+bool CompiledGraph<T, Activation, Acc>::needsCompaction() {
+	return liveCount * 2 < (int)sources.size();
+}
+
+template <class T, class Activation, class Acc>
+void CompiledGraph<T, Activation, Acc>::removeConnection(int id, int inConIndex) {
+	int p = position[id];
+	int index = rowOffsets[p] + inConIndex;
+	int last = --rowEnds[p];
+
+	//Swap and pop, like inCon
+	sources[index] = sources[last];
+	weights[index] = weights[last];
+	bufferState[index] = bufferState[last];
+	connections[index] = connections[last];
+	for (int b = 0; b < lanes; ++b) {
+		buffers[0][index * lanes + b] = buffers[0][last * lanes + b];
+		buffers[1][index * lanes + b] = buffers[1][last * lanes + b];
 	}
 
-	//Get HiddenNodes
-	int hiddenNodes;
-	in >> hiddenNodes;
+	//Free the last slot
+	sources[last] = -1;
+	--liveCount;
+	eventsReady = false;
+	settleReady = false;
+}
 
-	//cout << "HiddenNodes=" << hiddenNodes << endl;
-	if (hiddenNodes < 0) {
-		//Error
-		in.close();
-		//cout << "Wrong hiddenNodes." << endl;
-		return false;
-	}
+template <class T, class Activation, class Acc>
+bool CompiledGraph<T, Activation, Acc>::addConnection(ConnectionPool<T>& pool, ConnectionHandle handle) {
+	Connection<T>& c = pool[handle];
+	int id = c.getOutNodeId();
+	if (id < 0 || id >= nodeCount || c.getInNodeId() < 0 || c.getInNodeId() >= nodeCount)return false;
 
+	int p = position[id];
+	if (rowEnds[p] == rowOffsets[p + 1])return false;
 
-	in.read(str, 13);
-	//cout << "Read: " << str << endl;//Check if keyword correct
-	if (strcmp(str, "\nOutputNodes=")) {
-		//Error
-		in.close();
-		//cout << "Wrong keyword." << endl;
-		return false;
+	int index = rowEnds[p]++;
+	sources[index] = position[c.getInNodeId()];
+	weights[index] = c.getWeight();
+
+	//Stored the same way as compile(), but relative to the current parity
+	bool state = c.getBufferState();
+	for (int b = 0; b < lanes; ++b) {
+		buffers[parity][index * lanes + b] = state ? c.getBBuffer() : c.getABuffer();
+		buffers[!parity][index * lanes + b] = state ? c.getABuffer() : c.getBBuffer();
 	}
+	bufferState[index] = state != flipped;
+	connections[index] = handle;
+	++liveCount;
+	eventsReady = false;
+	settleReady = false;
+	return true;
+}
 
-	//Get outputNodes
-	int outputNodes;
-	in >> outputNodes;
+template <class T, class Activation, class Acc>
+int CompiledGraph<T, Activation, Acc>::getPosition(int id) {
+	return position[id];
+}
 
-	//cout << "OutputNodes=" << outputNodes << endl;
-	if (outputNodes < 0) {
-		//Error
-		in.close();
-		//cout << "Wrong outputNodes." << endl;
-		return false;
-	}
+template <class T, class Activation, class Acc>
+void CompiledGraph<T, Activation, Acc>::setNodeOrder(NodeOrder order) {
+	nodeOrder = order;
+}
 
+template <class T, class Activation, class Acc>
+int CompiledGraph<T, Activation, Acc>::getInDegree(int position) {
+	return rowEnds[position] - rowOffsets[position];
+}
 
-	in.read(str, 13);
-	//cout << "Read: " << str << endl;//Check if keyword correct
-	if (strcmp(str, "\nConnections=")) {
-		//Error
-		in.close();
-		//cout << "Wrong keyword." << endl;
-		return false;
-	}
+template <class T, class Activation, class Acc>
+int CompiledGraph<T, Activation, Acc>::getSlotSize() {
+	return sources.size();
+}
 
-	//Get HiddenNodes
-	int connections;
-	in >> connections;
+template <class T, class Activation, class Acc>
+int CompiledGraph<T, Activation, Acc>::getConnectionSize() {
+	return liveCount;
+}
 
-	//cout << "Connections=" << connections << endl;
-	if (connections < 0) {
-		//Error
-		in.close();
-		//cout << "Wrong connections." << endl;
-		return false;
-	}
+template <class T, class Activation, class Acc>
+int CompiledGraph<T, Activation, Acc>::getNodeSize() {
+	return nodeCount;
+}
 
-	//Read extra '\n'
-	in.read(str, 1);
+template <class T, class Activation, class Acc>
+void CompiledGraph<T, Activation, Acc>::clear() {
+	inputCount = outputCount = nodeCount = 0;
+	lanes = 1;
+	rowOffsets.clear();
+	rowEnds.clear();
+	liveCount = 0;
+	sources.clear();
+	weights.clear();
+	buffers[0].clear();
+	buffers[1].clear();
+	bufferState.clear();
+	activationGroups.clear();
+	position.clear();
+	order.clear();
+	parity = false;
+	flipped = false;
+	values.clear();
+	connections.clear();
+	mapping.reset();
+	eventsReady = false;
+	settleReady = false;
+}
 
-	//Prepare for initialization
-	cleanUp();
+template <class T, class Activation, class Acc>
+void CompiledGraph<T, Activation, Acc>::compile(ConnectionPool<T>& pool, vector<InputGraphNode<T>>& inputNodes, vector<OutputGraphNode<T>>& outputNodes, vector<GraphNode<T>>& graphNodes, int lanes, const vector<unsigned char>& activations) {
+	clear();
+	this->lanes = lanes;
 
-	//Initialize with given inputNodes and outputNodes
-	initialize(inputNodes, outputNodes);
+	inputCount = inputNodes.size();
+	outputCount = outputNodes.size();
+	nodeCount = inputCount + outputCount + graphNodes.size();
+	placeNodes(pool, inputNodes, outputNodes, graphNodes);
 
-	//Add all nodes
-	addNodes(hiddenNodes);
+	//Count incoming connections of each node
+	rowEnds.assign(nodeCount, 0);
+	for (int i = 0; i < inputCount; ++i)
+		rowEnds[i] = inputNodes[i].getInCon().size();
+	for (int i = 0; i < outputCount; ++i)
+		rowEnds[inputCount + i] = outputNodes[i].getInCon().size();
+	for (int i = 0; i < graphNodes.size(); ++i)
+		rowEnds[position[inputCount + outputCount + i]] = graphNodes[i].getInCon().size();
+
+	//Leave free slots in every row for connections added later
+	rowOffsets.assign(nodeCount + 1, 0);
+	liveCount = 0;
+	for (int i = 0; i < nodeCount; ++i) {
+		liveCount += rowEnds[i];
+		rowOffsets[i + 1] = rowOffsets[i] + rowEnds[i] + rowEnds[i] / 8 + 1;
+		rowEnds[i] += rowOffsets[i];
+	}
 
-	//Run for each connection
-	int inNode, outNode;
-	T weight, ABuffer, BBuffer;
-	bool useABuffer;
-	try {
-		//cout << "Entered" << endl;
-		for (int i = 0; i < connections; ++i) {
-			in.read(reinterpret_cast<char*>(&inNode), sizeof(int));
-			in.read(reinterpret_cast<char*>(&outNode), sizeof(int));
-			in.read(reinterpret_cast<char*>(&weight), sizeof(T));
-			in.read(reinterpret_cast<char*>(&ABuffer), sizeof(T));
-			in.read(reinterpret_cast<char*>(&BBuffer), sizeof(T));
-			in.read(reinterpret_cast<char*>(&useABuffer), sizeof(bool));
-			//cout << "I=" << inNode << "\tO=" << outNode << "\tw=" << weight << "\tA=" << ABuffer << "\tB=" << BBuffer << "\tS=" << useABuffer << endl;
-			addConnection(inNode, outNode, weight, ABuffer, BBuffer, useABuffer);
+	int count = rowOffsets[nodeCount];
+	sources.assign(count, -1);
+	weights.resize(count);
+	buffers[0].resize(count * lanes);
+	buffers[1].resize(count * lanes);
+	bufferState.assign(count, false);
+	connections.assign(count, 0);
+
+	//Keep the order of inCon so sums are accumulated in the same order as GraphNode::run()
+	auto fill = [&](int id, vector<ConnectionHandle>& inCon) {
+		int index = rowOffsets[id];
+		for (ConnectionHandle handle : inCon) {
+			Connection<T>& c = pool[handle];
+			sources[index] = position[c.getInNodeId()];
+			weights[index] = c.getWeight();
+			//Connection reads BBuffer and writes ABuffer when useABuffer is set
+			bool state = c.getBufferState();
+			for (int b = 0; b < lanes; ++b) {
+				buffers[parity][index * lanes + b] = state ? c.getBBuffer() : c.getABuffer();
+				buffers[!parity][index * lanes + b] = state ? c.getABuffer() : c.getBBuffer();
+			}
+			bufferState[index] = state;
+			connections[index] = handle;
+			++index;
 		}
+	};
+	for (int i = 0; i < inputCount; ++i)
+		fill(i, inputNodes[i].getInCon());
+	for (int i = 0; i < outputCount; ++i)
+		fill(inputCount + i, outputNodes[i].getInCon());
+	for (int i = 0; i < graphNodes.size(); ++i)
+		fill(position[inputCount + outputCount + i], graphNodes[i].getInCon());
+
+	groupActivations(activations);
+
+	//Initial values
+	values.assign(nodeCount * lanes, Acc(0));
+	for (int b = 0; b < lanes; ++b) {
+		for (int i = 0; i < inputCount; ++i)
+			setValue(i, inputNodes[i].get(), b);
+		for (int i = 0; i < outputCount; ++i)
+			setValue(inputCount + i, outputNodes[i].get(), b);
 	}
-	catch (fstream::failure e) {
-		cerr << "Load operation failed." << endl;
-		in.close();
-		return false;
+}
+
+template <class T, class Activation, class Acc>
+void CompiledGraph<T, Activation, Acc>::groupActivations(const vector<unsigned char>& activations) {
+	//Group nodes by activation if they do not all use Activation
+	bool mixed = false;
+	for (int i = inputCount; i < activations.size() && i < nodeCount; ++i)
+		if (activations[i] != ACTIVATION_DEFAULT)mixed = true;
+	if (mixed) {
+		activationGroups.resize(ACTIVATION_COUNT);
+		for (int p = inputCount; p < nodeCount; ++p)
+			activationGroups[order[p] < activations.size() ? activations[order[p]] : (unsigned char)ACTIVATION_DEFAULT].push_back(p);
 	}
+}
 
-	in.close();
+template <class T, class Activation, class Acc>
+void CompiledGraph<T, Activation, Acc>::placeNodes(ConnectionPool<T>& pool, vector<InputGraphNode<T>>& inputNodes, vector<OutputGraphNode<T>>& outputNodes, vector<GraphNode<T>>& graphNodes) {
+	int hiddenStart = inputCount + outputCount;
+	auto node = [&](int id) -> GraphNode<T>& {
+		if (id < inputCount)return inputNodes[id];
+		if (id < hiddenStart)return outputNodes[id - inputCount];
+		return graphNodes[id - hiddenStart];
+	};
+	auto degree = [&](int id) {
+		return node(id).getInCon().size() + node(id).getOutCon().size();
+	};
+
+	//Input and output nodes keep their ids
+	order.clear();
+	order.reserve(nodeCount);
+	for (int i = 0; i < hiddenStart; ++i)
+		order.push_back(i);
+
+	vector<int> hidden(nodeCount - hiddenStart);
+	for (int i = 0; i < hidden.size(); ++i)
+		hidden[i] = hiddenStart + i;
+
+	if (nodeOrder == ORDER_DEGREE)
+		stable_sort(hidden.begin(), hidden.end(), [&](int a, int b) { return degree(a) > degree(b); });
+
+	if (nodeOrder == ORDER_BFS || nodeOrder == ORDER_RCM) {
+		vector<char> placed(nodeCount, 0);
+		for (int i = 0; i < hiddenStart; ++i)
+			placed[i] = 1;
+
+		//Visit hidden neighbours of order[next] until every reachable node is placed
+		//Cuthill-McKee visits neighbours with fewer connections first
+		int next = 0;
+		vector<int> neighbours;
+		auto visit = [&]() {
+			for (; next < order.size(); ++next) {
+				GraphNode<T>& n = node(order[next]);
+				neighbours.clear();
+				for (ConnectionHandle h : n.getInCon())
+					neighbours.push_back(pool[h].getInNodeId());
+				for (ConnectionHandle h : n.getOutCon())
+					neighbours.push_back(pool[h].getOutNodeId());
+				if (nodeOrder == ORDER_RCM)
+					stable_sort(neighbours.begin(), neighbours.end(), [&](int a, int b) { return degree(a) < degree(b); });
+
+				for (int id : neighbours)
+					if (id >= 0 && id < nodeCount && !placed[id]) {
+						placed[id] = 1;
+						order.push_back(id);
+					}
+			}
+		};
+
+		//BFS starts from input and output nodes, Cuthill-McKee from a node of lowest degree
+		if (nodeOrder == ORDER_BFS)
+			visit();
+		else {
+			next = order.size();
+			stable_sort(hidden.begin(), hidden.end(), [&](int a, int b) { return degree(a) < degree(b); });
+		}
 
-	return true;
+		//Every unreached part of the graph starts from its first node in hidden
+		for (int id : hidden)
+			if (!placed[id]) {
+				placed[id] = 1;
+				order.push_back(id);
+				visit();
+			}
+
+		if (nodeOrder == ORDER_RCM)
+			reverse(order.begin() + hiddenStart, order.end());
+	}
+	else
+		order.insert(order.end(), hidden.begin(), hidden.end());
+
+	position.resize(nodeCount);
+	for (int p = 0; p < nodeCount; ++p)
+		position[order[p]] = p;
 }
 
-template <class T>
-void EvolutionGNN<T>::save(string filename) {
-	fstream output(filename, ios::out | ios::binary);
+template <class T, class Activation>
+QuantizedGraph<T, Activation>::QuantizedGraph() {
+	clear();
+}
 
-	//Write input nodes
-	output << "InputNodes=" << inputNodes.size() << endl;
+template <class T, class Activation>
+void QuantizedGraph<T, Activation>::clear() {
+	bits = 0;
+	inputCount = outputCount = nodeCount = 0;
+	valueScale = weightScale = 1.0;
+	rowOffsets.clear();
+	sources.clear();
+	weights.clear();
+	buffers[0].clear();
+	buffers[1].clear();
+	values.clear();
+	activations.clear();
+	connections.clear();
+	bufferState.clear();
+	parity = false;
+	flipped = false;
+}
 
-	//Write hidden nodes
-	output << "HiddenNodes=" << graphNodes.size() << endl;
+template <class T, class Activation>
+bool QuantizedGraph<T, Activation>::build(ConnectionPool<T>& pool, vector<InputGraphNode<T>>& inputNodes, vector<OutputGraphNode<T>>& outputNodes, vector<GraphNode<T>>& graphNodes, int bits, T range, const vector<unsigned char>& activations) {
+	clear();
+	if (bits != 8 && bits != 16)return false;
+	this->bits = bits;
+
+	inputCount = inputNodes.size();
+	outputCount = outputNodes.size();
+	nodeCount = inputCount + outputCount + graphNodes.size();
+	auto node = [&](int id) -> GraphNode<T>& {
+		if (id < inputCount)return inputNodes[id];
+		if (id < inputCount + outputCount)return outputNodes[id - inputCount];
+		return graphNodes[id - inputCount - outputCount];
+	};
+
+	//Incoming connections of each node, in the order of inCon like GraphNode::run()
+	rowOffsets.assign(nodeCount + 1, 0);
+	for (int id = 0; id < nodeCount; ++id)
+		rowOffsets[id + 1] = rowOffsets[id] + node(id).getInCon().size();
+	int count = rowOffsets[nodeCount];
+	sources.resize(count);
+	connections.resize(count);
+	bufferState.resize(count);
+
+	//Scales from the largest magnitudes
+	double qmax = (1 << (bits - 1)) - 1;
+	double maxWeight = 0;
+	for (int id = 0; id < nodeCount; ++id)
+		for (ConnectionHandle handle : node(id).getInCon())
+			maxWeight = max(maxWeight, fabs((double)pool[handle].getWeight()));
+	weightScale = maxWeight > 0 ? maxWeight / qmax : 1.0;
+	valueScale = (range > T(0) ? (double)range : 1.0) / qmax;
+
+	int bytes = bits / 8;
+	weights.resize(count * bytes);
+	buffers[0].resize(count * bytes);
+	buffers[1].resize(count * bytes);
+	values.assign(nodeCount * bytes, 0);
+
+	auto fill = [&](auto* weight, auto* read, auto* write) {
+		typedef typename remove_pointer<decltype(weight)>::type Q;
+		int index = 0;
+		for (int id = 0; id < nodeCount; ++id)
+			for (ConnectionHandle handle : node(id).getInCon()) {
+				Connection<T>& c = pool[handle];
+				sources[index] = c.getInNodeId();
+				weight[index] = (Q)llround(c.getWeight() / weightScale);
+
+				//Connection reads BBuffer and writes ABuffer when useABuffer is set
+				bool state = c.getBufferState();
+				read[index] = quantizeValue<Q>(state ? c.getBBuffer() : c.getABuffer());
+				write[index] = quantizeValue<Q>(state ? c.getABuffer() : c.getBBuffer());
+				bufferState[index] = state;
+				connections[index] = handle;
+				++index;
+			}
+	};
+	if (bits == 8)
+		fill((int8_t*)weights.data(), (int8_t*)buffers[0].data(), (int8_t*)buffers[1].data());
+	else
+		fill((int16_t*)weights.data(), (int16_t*)buffers[0].data(), (int16_t*)buffers[1].data());
 
-	//Write output nodes
-	output << "OutputNodes=" << outputNodes.size() << endl;
+	this->activations.assign(nodeCount, Activation::id);
+	for (int id = inputCount; id < activations.size() && id < nodeCount; ++id)
+		if (activations[id] != ACTIVATION_DEFAULT)
+			this->activations[id] = activations[id];
 
-	//Write all connections
-	output << "Connections=" << con.size() << endl;
-	for (shared_ptr<Connection<T>> ptr : con)
-		ptr->writeToFile(output);
+	for (int i = 0; i < inputCount; ++i)
+		setValue(i, inputNodes[i].get());
+	for (int i = 0; i < outputCount; ++i)
+		setValue(inputCount + i, outputNodes[i].get());
+	return true;
+}
 
-	output.close();
+template <class T, class Activation>
+const vector<float>& QuantizedGraph<T, Activation>::getTanhTable() {
+	static const vector<float> table = []() {
+		vector<float> t(QUANTIZE_TABLE_SIZE + 1);
+		for (int i = 0; i <= QUANTIZE_TABLE_SIZE; ++i)
+			t[i] = tanh(QUANTIZE_TABLE_RANGE * (2.0 * i / QUANTIZE_TABLE_SIZE - 1.0));
+		return t;
+	}();
+	return table;
 }
 
-template <class T>
-void EvolutionGNN<T>::removeDisconnectedConnections() {
-	//Remove useless connectinos for each input Node
-	for (int i = 0; i < inputNodes.size(); ++i)
-		inputNodes[i].removeDisconnectedConnections();
+template <class T, class Activation>
+template <class Q>
+Q QuantizedGraph<T, Activation>::quantizeValue(double val) {
+	double qmax = (1 << (bits - 1)) - 1;
+	double q = nearbyint(val / valueScale);
+	return (Q)(q > qmax ? qmax : (q < -qmax ? -qmax : q));
+}
 
-	//Remove useless connectinos for each output Node
-	for (int i = 0; i < outputNodes.size(); ++i)
-		outputNodes[i].removeDisconnectedConnections();
+template <class T, class Activation>
+template <class Q>
+Q QuantizedGraph<T, Activation>::activate(int id, double sum) {
+	if (activations[id] != ACTIVATION_TANH)
+		return quantizeValue<Q>(applyActivation<Activation>(activations[id], (T)sum));
+
+	//Linear interpolation between the two nearest entries
+	const vector<float>& table = getTanhTable();
+	double t = (sum + QUANTIZE_TABLE_RANGE) * (QUANTIZE_TABLE_SIZE / (2.0 * QUANTIZE_TABLE_RANGE));
+	if (t <= 0)return quantizeValue<Q>(-1.0);
+	if (t >= QUANTIZE_TABLE_SIZE)return quantizeValue<Q>(1.0);
+	int k = (int)t;
+	return quantizeValue<Q>(table[k] + (table[k + 1] - table[k]) * (t - k));
+}
 
-	//Remove useless connections for each hidden node
-	for (auto i = graphNodes.begin(); i != graphNodes.end(); ++i)
-		i->second.removeDisconnectedConnections();
+template <class T, class Activation>
+template <class Q, class Acc>
+void QuantizedGraph<T, Activation>::runNodesAs() {
+	const int* offsets = rowOffsets.data();
+	const Q* w = (const Q*)weights.data();
+	const Q* read = (const Q*)buffers[parity].data();
+	Q* value = (Q*)values.data();
+	double sumScale = weightScale * valueScale;
+
+	//Input nodes keep their input values
+	for (int n = inputCount; n < nodeCount; ++n) {
+		Acc sum = 0;
+		for (int i = offsets[n]; i < offsets[n + 1]; ++i)
+			sum += (Acc)w[i] * read[i];
+		value[n] = activate<Q>(n, sum * sumScale);
+	}
+}
 
-	//Remove disconnected connections
-	vector<int> indexes;
-	for (int i = 0; i < con.size(); ++i)
-		if (con[i]->disconnected())indexes.push_back(i);
+template <class T, class Activation>
+template <class Q>
+void QuantizedGraph<T, Activation>::writeConnectionsAs() {
+	const int* src = sources.data();
+	const Q* value = (const Q*)values.data();
+	Q* write = (Q*)buffers[!parity].data();
+	int count = sources.size();
+	for (int i = 0; i < count; ++i) {
+		int s = src[i];
 
-	for (int i = indexes.size() - 1; i >= 0; --i) {
-		con.erase(con.begin() + indexes[i]);
-		indexes.pop_back();
+		//Output nodes never write to their out-going connections
+		if (s >= inputCount && s < inputCount + outputCount)continue;
+		write[i] = value[s];
 	}
 }
 
-template <class T>
-void EvolutionGNN<T>::removeConnection(int index) {
-	con.erase(con.begin() + index);
+template <class T, class Activation>
+void QuantizedGraph<T, Activation>::runNodes() {
+	if (bits == 8)runNodesAs<int8_t, int32_t>();
+	else if (bits == 16)runNodesAs<int16_t, int64_t>();
 }
 
-template <class T>
-void EvolutionGNN<T>::addRandomConnection(int count, unsigned int randomState) {
-	default_random_engine generator(randomState);
-	normal_distribution<double> distribution(1.0, 1.0);
-	for (int i = 0; i < count; ++i)
-		addConnection(rand() % nodeCount, rand() % (nodeCount - inputNodes.size()) + inputNodes.size(), rand() % 20000 / 1000.0 - 10.0);
+template <class T, class Activation>
+void QuantizedGraph<T, Activation>::writeConnections() {
+	if (bits == 8)writeConnectionsAs<int8_t>();
+	else if (bits == 16)writeConnectionsAs<int16_t>();
 }
 
-template <class T>
-void EvolutionGNN<T>::addConnection(int node1, int node2, T weight, T ABuffer, T BBuffer, bool useABuffer) {
+template <class T, class Activation>
+void QuantizedGraph<T, Activation>::flipBuffer() {
+	parity = !parity;
+	flipped = !flipped;
+}
 
-	//Create Connection
-	shared_ptr<Connection<T>> ptr = make_shared<Connection<T>>(node1, node2, weight, ABuffer, BBuffer, useABuffer);
+template <class T, class Activation>
+T QuantizedGraph<T, Activation>::getValue(int id) {
+	if (bits == 8)return T(((int8_t*)values.data())[id] * valueScale);
+	if (bits == 16)return T(((int16_t*)values.data())[id] * valueScale);
+	return T(0);
+}
 
-	//Added to Connections
-	con.push_back(ptr);
+template <class T, class Activation>
+void QuantizedGraph<T, Activation>::setValue(int id, T val) {
+	if (bits == 8)((int8_t*)values.data())[id] = quantizeValue<int8_t>(val);
+	else if (bits == 16)((int16_t*)values.data())[id] = quantizeValue<int16_t>(val);
+}
 
-	//Added as outCon to node1
-	if (node1 < inputNodes.size())
-		inputNodes[node1].addOutCon(ptr);
-	else
-		if (node1 < inputNodes.size() + outputNodes.size())
-			outputNodes[node1 - inputNodes.size()].addOutCon(ptr);
-		else
-			graphNodes[node1].addOutCon(ptr);
+template <class T, class Activation>
+int QuantizedGraph<T, Activation>::getBits() {
+	return bits;
+}
 
-	//Added as inCon to node2
-	if (node2 < inputNodes.size())
-		inputNodes[node2].addInCon(ptr);
-	else
-		if (node2 < inputNodes.size() + outputNodes.size())
-			outputNodes[node2 - inputNodes.size()].addInCon(ptr);
-		else
-			graphNodes[node2].addInCon(ptr);
+template <class T, class Activation>
+int QuantizedGraph<T, Activation>::getConnectionBytes() {
+	return 3 * bits / 8;
 }
 
-template <class T>
-void EvolutionGNN<T>::addNodes(int count) {
-	for (int i = 0; i < count; ++i) {
-		graphNodes.emplace(nodeCount, GraphNode<T>(nodeCount));
-		++nodeCount;
+template <class T, class Activation>
+void QuantizedGraph<T, Activation>::writeBack(ConnectionPool<T>& pool) {
+	auto buffer = [&](bool side, int i) {
+		if (bits == 8)return T(((int8_t*)buffers[side].data())[i] * valueScale);
+		return T(((int16_t*)buffers[side].data())[i] * valueScale);
+	};
+	for (int i = 0; i < connections.size(); ++i) {
+		//Every flip since build toggled the logical buffer state
+		bool state = bufferState[i] != flipped;
+		T read = buffer(parity, i);
+		T write = buffer(!parity, i);
+
+		Connection<T>& c = pool[connections[i]];
+		c.setABuffer(state ? write : read);
+		c.setBBuffer(state ? read : write);
+		c.setBufferState(state);
 	}
 }
 
-template <class T>
-T EvolutionGNN<T>::getOutput(int index) {
-	return outputNodes[index].get();
+template <class T, class Activation, class Acc>
+CompiledGraph<T, Activation, Acc>::CompiledGraph() {
+	inputCount = outputCount = nodeCount = 0;
+	lanes = 1;
+	liveCount = 0;
+	nodeOrder = ORDER_ID;
+	tanhMode = TANH_EXACT;
+	parity = false;
+	flipped = false;
+	eventDriven = false;
+	epsilon = T(0);
+	eventsReady = false;
+	warmSteps = 0;
+	eventStep = 0;
+	settling = false;
+	settleReady = false;
 }
 
-template <class T>
-double EvolutionGNN<T>::taskArranger(double x) {
-	//return pow(x, M_E);
-	return x;
+template <class X>
+bool CompiledArray<X>::isView() {
+	return elements != owned.data();
 }
 
-template <class T>
-int EvolutionGNN<T>::determineNumberOfThread() {
-	//Current method depends on number of connections
-	int maxThread = threadCount;
-	if (maxThread <= 0)maxThread = 1;
-
-	int calculated = con.size() / 100000;
-	if (calculated <= 0)calculated = 1;
-	if (calculated > maxThread)calculated = maxThread;
-
-	return calculated;
+template <class X>
+X& CompiledArray<X>::operator[](size_t index) {
+	return elements[index];
 }
 
-template <class T>
-void EvolutionGNN<T>::thread_run(int startId, int endId, int dummy) {
-	//cout << "Id = " << dummy << "  from " << startId << " to " << endId << endl;
-	//cout << dummy << " Started." << endl;
-	//Run inputNodes
-	if (startId < inputNodes.size()) {
-		int start = startId;
-		int end = (endId < inputNodes.size() ? endId : inputNodes.size());
-		for (int i = start; i < end; ++i)
-			inputNodes[i].run();
-	}
-
-	//Run outputNodes
-	if (startId < inputNodes.size() + outputNodes.size() && endId > inputNodes.size()) {
-		int start = (startId < inputNodes.size() ? inputNodes.size() : startId) - inputNodes.size();
-		int end = (endId > inputNodes.size() + outputNodes.size() ? inputNodes.size() + outputNodes.size() : endId) - inputNodes.size();
-		for (int i = start; i < end; ++i)
-			outputNodes[i].run();
-	}
+template <class X>
+X* CompiledArray<X>::data() {
+	return elements;
+}
 
-	//Run hiddenNodes
-	if (endId > inputNodes.size() + outputNodes.size()) {
-		int start = (startId < inputNodes.size() + outputNodes.size() ? inputNodes.size() + outputNodes.size() : startId) - inputNodes.size() - outputNodes.size();
-		int end = endId - inputNodes.size() - outputNodes.size();
-		auto s = graphNodes.begin();
-		//Loop until s point to the correct one
-		for (int i = 0; i < start; ++i)s++;
-		int count = end - start;
-		for (int i = 0; i < count; ++i) {
-			s->second.run();
-			s++;
-		}
-	}
-	//cout << dummy << " Completed." << endl;
+template <class X>
+size_t CompiledArray<X>::size() const {
+	return count;
 }
 
-template <class T>
-void EvolutionGNN<T>::run() {
-	int numOfThread = determineNumberOfThread();
-	if (numOfThread <= 1) {
-		//Order doesn't matter
+template <class X>
+void CompiledArray<X>::clear() {
+	owned.clear();
+	elements = owned.data();
+	count = 0;
+}
 
-		//Run all input nodes
-		for (int i = 0; i < inputNodes.size(); ++i)
-			inputNodes[i].run();
+template <class X>
+void CompiledArray<X>::resize(size_t count) {
+	//A viewed array is copied before it grows
+	if (elements != owned.data())owned.assign(elements, elements + this->count);
+	owned.resize(count);
+	elements = owned.data();
+	this->count = count;
+}
 
-		//Run all output nodes
-		for (int i = 0; i < outputNodes.size(); ++i)
-			outputNodes[i].run();
+template <class X>
+void CompiledArray<X>::assign(size_t count, const X& val) {
+	owned.assign(count, val);
+	elements = owned.data();
+	this->count = count;
+}
 
-		//Run all hidden nodes
-		for (auto i = this->graphNodes.begin(); i != this->graphNodes.end(); i++)
-			i->second.run();
-	}
-	else {
+template <class X>
+void CompiledArray<X>::view(X* elements, size_t count) {
+	owned.clear();
+	owned.shrink_to_fit();
+	this->elements = elements;
+	this->count = count;
+}
 
-		//Considering multi-threaded execution
-		vector<thread> threadPool;
-		for (int i = numOfThread - 1; i >= 0; --i)
-			threadPool.push_back(thread(&EvolutionGNN<T>::thread_run, this, taskArranger(1.0 * i / numOfThread) * nodeCount, taskArranger(1.0 * (i + 1) / numOfThread) * nodeCount, i));
+template <class X>
+CompiledArray<X>& CompiledArray<X>::operator=(CompiledArray<X>&& other) {
+	owned = move(other.owned);
+	elements = other.elements;
+	count = other.count;
+	other.elements = nullptr;
+	other.count = 0;
+	return *this;
+}
 
-		//Wait for all thread to finish
-		for (int i = 0; i < threadPool.size(); ++i)
-			threadPool[i].join();
+template <class X>
+CompiledArray<X>& CompiledArray<X>::operator=(const CompiledArray<X>& other) {
+	if (this != &other) {
+		owned.assign(other.elements, other.elements + other.count);
+		elements = owned.data();
+		count = other.count;
 	}
+	return *this;
 }
 
-template <class T>
-void EvolutionGNN<T>::thread_flipBuffer(int startId, int endId, int dummy) {
-	//cout << "Id = " << dummy << "  from " << startId << " to " << endId << endl;
-	//cout << dummy << " Started." << endl;
-	//Run inputNodes
-	if (startId < inputNodes.size()) {
-		int start = startId;
-		int end = (endId < inputNodes.size() ? endId : inputNodes.size());
-		for (int i = start; i < end; ++i)
-			inputNodes[i].flipBuffer();
-	}
+template <class X>
+CompiledArray<X>::CompiledArray(CompiledArray<X>&& other) {
+	owned = move(other.owned);
+	elements = other.elements;
+	count = other.count;
+	other.elements = nullptr;
+	other.count = 0;
+}
 
-	//Run outputNodes
-	if (startId < inputNodes.size() + outputNodes.size() && endId > inputNodes.size()) {
-		int start = (startId < inputNodes.size() ? inputNodes.size() : startId) - inputNodes.size();
-		int end = (endId > inputNodes.size() + outputNodes.size() ? inputNodes.size() + outputNodes.size() : endId) - inputNodes.size();
-		for (int i = start; i < end; ++i)
-			outputNodes[i].flipBuffer();
-	}
+template <class X>
+CompiledArray<X>::CompiledArray(const CompiledArray<X>& other) {
+	owned.assign(other.elements, other.elements + other.count);
+	elements = owned.data();
+	count = other.count;
+}
 
-	//Run hiddenNodes
-	if (endId > inputNodes.size() + outputNodes.size()) {
-		int start = (startId < inputNodes.size() + outputNodes.size() ? inputNodes.size() + outputNodes.size() : startId) - inputNodes.size() - outputNodes.size();
-		int end = endId - inputNodes.size() - outputNodes.size();
-		auto s = graphNodes.begin();
-		//Loop until s point to the correct one
-		for (int i = 0; i < start; ++i)s++;
-		int count = end - start;
-		for (int i = 0; i < count; ++i) {
-			s->second.flipBuffer();
-			s++;
-		}
-	}
-	//cout << dummy << " Completed." << endl;
+template <class X>
+CompiledArray<X>::CompiledArray() {
+	elements = nullptr;
+	count = 0;
 }
 
-template <class T>
-void EvolutionGNN<T>::flipBuffer() {
-	int numOfThread = determineNumberOfThread();
-	if (numOfThread <= 1) {
-		//Order doesn't matter
+template <class X>
+X ArchiveCodec::xorBits(X a, X b) {
+	unsigned char x[sizeof(X)], y[sizeof(X)];
+	memcpy(x, &a, sizeof(X));
+	memcpy(y, &b, sizeof(X));
+	for (int i = 0; i < sizeof(X); ++i)
+		x[i] ^= y[i];
+	memcpy(&a, x, sizeof(X));
+	return a;
+}
 
-		//Flip input Nodes
-		for (int i = 0; i < inputNodes.size(); ++i)
-			inputNodes[i].flipBuffer();
+inline bool ArchiveCodec::unpack(const char* data, size_t size, size_t& offset, void* values, size_t count, size_t width) {
+	long long length;
+	if (offset > size || size - offset < sizeof(length))return false;
+	memcpy(&length, data + offset, sizeof(length));
+	offset += sizeof(length);
+	if (length < 0 || (size_t)length > size - offset)return false;
+
+	//Undo the run-length encoding, then gather byte b of every value
+	vector<unsigned char> shuffled(count * width);
+	if (!decodeRuns(reinterpret_cast<const unsigned char*>(data + offset), length, shuffled.data(), shuffled.size()))return false;
+	offset += length;
+
+	unsigned char* bytes = reinterpret_cast<unsigned char*>(values);
+	for (size_t b = 0; b < width; ++b)
+		for (size_t i = 0; i < count; ++i)
+			bytes[i * width + b] = shuffled[b * count + i];
+	return true;
+}
 
-		//Flip output Nodes
-		for (int i = 0; i < outputNodes.size(); ++i)
-			outputNodes[i].flipBuffer();
+inline void ArchiveCodec::pack(vector<char>& out, const void* values, size_t count, size_t width) {
+	//Byte b of every value is stored together
+	const unsigned char* bytes = reinterpret_cast<const unsigned char*>(values);
+	vector<unsigned char> shuffled(count * width);
+	for (size_t b = 0; b < width; ++b)
+		for (size_t i = 0; i < count; ++i)
+			shuffled[b * count + i] = bytes[i * width + b];
+
+	//Size of the encoded data is written once it is known
+	size_t at = out.size();
+	out.resize(at + sizeof(long long));
+	encodeRuns(out, shuffled.data(), shuffled.size());
+	long long length = out.size() - at - sizeof(long long);
+	memcpy(out.data() + at, &length, sizeof(length));
+}
 
-		//Flip hidden Nodes
-		for (auto i = graphNodes.begin(); i != graphNodes.end(); i++)
-			i->second.flipBuffer();
+inline bool ArchiveCodec::decodeRuns(const unsigned char* data, size_t size, unsigned char* bytes, size_t count) {
+	size_t i = 0, o = 0;
+	while (i < size) {
+		unsigned char h = data[i++];
+		if (h < 128) {
+			size_t length = h + 1;
+			if (size - i < length || count - o < length)return false;
+			memcpy(bytes + o, data + i, length);
+			i += length;
+			o += length;
+		}
+		else {
+			size_t length = h - 125;
+			if (i == size || count - o < length)return false;
+			memset(bytes + o, data[i++], length);
+			o += length;
+		}
 	}
-	else {
-		vector<thread> threadPool;
-		for (int i = numOfThread - 1; i >= 0; --i)
-			threadPool.push_back(thread(&EvolutionGNN<T>::thread_flipBuffer, this, taskArranger(1.0 * i / numOfThread) * nodeCount, taskArranger(1.0 * (i + 1) / numOfThread) * nodeCount, i));
+	return o == count;
+}
+
+inline void ArchiveCodec::encodeRuns(vector<char>& out, const unsigned char* bytes, size_t count) {
+	size_t i = 0, literal = 0;
+	auto flush = [&]() {
+		//Literal bytes [i - literal, i) in pieces of up to 128
+		for (size_t start = i - literal; start < i;) {
+			size_t length = min(i - start, (size_t)128);
+			out.push_back(char(length - 1));
+			out.insert(out.end(), bytes + start, bytes + start + length);
+			start += length;
+		}
+		literal = 0;
+	};
+
+	while (i < count) {
+		size_t run = 1;
+		while (i + run < count && run < 130 && bytes[i + run] == bytes[i])++run;
+
+		//Runs shorter than 3 are cheaper as literals
+		if (run < 3) {
+			++i;
+			++literal;
+			continue;
+		}
 
-		//Wait for all thread to finish
-		for (int i = 0; i < threadPool.size(); ++i)
-			threadPool[i].join();
+		flush();
+		out.push_back(char(run + 125));
+		out.push_back(char(bytes[i]));
+		i += run;
 	}
+	flush();
 }
 
-template <class T>
-void EvolutionGNN<T>::setInput(int index, T val) {
-	inputNodes[index] = val;
+inline bool MappedFile::isMapped() {
+	return mapped;
 }
 
-template <class T>
-void EvolutionGNN<T>::cleanUp() {
-	this->inputNodes.clear();
-	this->outputNodes.clear();
-	this->graphNodes.clear();
-	this->con.clear();
+inline size_t MappedFile::getSize() {
+	return size;
 }
 
-template <class T>
-int EvolutionGNN<T>::getConnectionSize() {
-	return con.size();
+inline char* MappedFile::getData() {
+	return data;
 }
 
-template <class T>
-int EvolutionGNN<T>::getOutputSize() {
-	return outputNodes.size();
+inline void MappedFile::close() {
+#ifdef T_EVOLUTIONGRAPHNN_MMAP
+	if (mapped)munmap(data, size);
+#endif
+	storage.reset();
+	data = nullptr;
+	size = 0;
+	mapped = false;
 }
 
-template <class T>
-int EvolutionGNN<T>::getHiddenSize() {
-	return graphNodes.size();
+inline bool MappedFile::open(const string& path) {
+	close();
+
+#ifdef T_EVOLUTIONGRAPHNN_MMAP
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)return false;
+
+	struct stat info;
+	if (fstat(fd, &info) == 0 && info.st_size > 0) {
+		void* address = mmap(nullptr, info.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+		if (address != MAP_FAILED) {
+			data = reinterpret_cast<char*>(address);
+			size = info.st_size;
+			mapped = true;
+		}
+	}
+	::close(fd);
+	if (mapped)return true;
+#endif
+
+	//Read the whole file into a buffer aligned like a mapping
+	ifstream in(path, ios::in | ios::binary | ios::ate);
+	if (!in.is_open())return false;
+
+	size_t length = in.tellg();
+	storage.reset(new char[length + MODEL_ALIGNMENT]);
+	data = storage.get() + (MODEL_ALIGNMENT - reinterpret_cast<size_t>(storage.get()) % MODEL_ALIGNMENT) % MODEL_ALIGNMENT;
+	in.seekg(0);
+	in.read(data, length);
+	if (in.gcount() != (streamsize)length) {
+		close();
+		return false;
+	}
+	size = length;
+	return true;
 }
 
-template <class T>
-int EvolutionGNN<T>::getInputSize() {
-	return inputNodes.size();
+inline MappedFile::~MappedFile() {
+	close();
 }
 
-template <class T>
-void EvolutionGNN<T>::initialize(int inputCount, int outputCount, int threadCount) {
-	if (threadCount < 0)
-		this->threadCount = thread::hardware_concurrency() - 1;
-	else
-		this->threadCount = threadCount;
-	if (this->threadCount <= 0)
-		this->threadCount = 1;
+inline MappedFile::MappedFile() {
+	data = nullptr;
+	size = 0;
+	mapped = false;
+}
 
-	//Remove everything in case not
-	this->cleanUp();
+template <class X>
+unsigned int getNumberType() {
+#ifdef __FLT16_MAX__
+	if (is_same<X, _Float16>::value)return NUMBER_FLOAT16;
+#endif
+#ifdef __BFLT16_MAX__
+	if (is_same<X, __bf16>::value)return NUMBER_BFLOAT16;
+#endif
+	if (is_same<X, float>::value)return NUMBER_FLOAT;
+	if (is_same<X, double>::value)return NUMBER_DOUBLE;
+	if (is_same<X, long double>::value)return NUMBER_LONG_DOUBLE;
+	return NUMBER_UNKNOWN;
+}
 
-	//Initialize it as initializer
-	for (int i = 0; i < inputCount; ++i)
-		this->inputNodes.push_back(InputGraphNode<T>(i));
-	for (int i = 0; i < outputCount; ++i)
-		this->outputNodes.push_back(OutputGraphNode<T>(i + inputCount));
+template <class T, class Acc>
+vector<Acc> ModelHeader::getValues(const char* data) {
+	int nodes = getNodeSize();
+	const char* section = data + offsets[SECTION_VALUES];
+	if (version >= 3 && accumulatorSize == sizeof(Acc) && accumulatorType == getNumberType<Acc>()) {
+		const Acc* values = reinterpret_cast<const Acc*>(section);
+		return vector<Acc>(values, values + nodes);
+	}
 
-	nodeCount = inputCount + outputCount;
+	//Version 2, or accumulated in T
+	const T* values = reinterpret_cast<const T*>(section);
+	vector<Acc> converted(nodes);
+	for (int p = 0; p < nodes; ++p)
+		converted[p] = Acc(values[p]);
+	return converted;
 }
 
-template <class T>
-EvolutionGNN<T>::EvolutionGNN(EvolutionGNN<T>& parentA, EvolutionGNN<T>& parentB, double AConRate, double BConRate, bool inheritMemory) {
-	inherit(parentA, parentB, AConRate, BConRate, inheritMemory);
+template <class T, class Acc>
+bool ModelHeader::check(const char* data, size_t size) {
+	if (size < sizeof(ModelHeader) || memcmp(magic, MODEL_MAGIC, sizeof(MODEL_MAGIC)))return false;
+	if (version < 2 || version > MODEL_VERSION || byteOrder != MODEL_BYTE_ORDER || valueSize != sizeof(T) || alignment != MODEL_ALIGNMENT)return false;
+	if (version >= 3) {
+		bool accumulator = accumulatorSize == sizeof(Acc) && accumulatorType == getNumberType<Acc>();
+		bool value = accumulatorSize == sizeof(T) && accumulatorType == getNumberType<T>();
+		if (valueType != getNumberType<T>() || !(accumulator || value))return false;
+	}
+	if (inputCount < 0 || outputCount < 0 || hiddenCount < 0 || connectionCount < 0 || slotCount < connectionCount)return false;
+	if (getNodeSize() >= INT_MAX || slotCount >= INT_MAX || fileSize > (long long)size)return false;
+
+	//Every section lies inside the file at an aligned offset
+	for (int s = 0; s < SECTION_COUNT; ++s)
+		if (offsets[s] < (long long)sizeof(ModelHeader) || offsets[s] % alignment || offsets[s] > fileSize || fileSize - offsets[s] < getSectionSize(s))
+			return false;
+
+	int nodes = getNodeSize();
+	const int* rowOffsets = reinterpret_cast<const int*>(data + offsets[SECTION_ROW_OFFSETS]);
+	const int* rowEnds = reinterpret_cast<const int*>(data + offsets[SECTION_ROW_ENDS]);
+	const int* sources = reinterpret_cast<const int*>(data + offsets[SECTION_SOURCES]);
+	const int* indices = reinterpret_cast<const int*>(data + offsets[SECTION_INDICES]);
+	const int* order = reinterpret_cast<const int*>(data + offsets[SECTION_ORDER]);
+
+	//Rows cover all slots in order, live slots first, and every connection has one index in con
+	if (rowOffsets[0] != 0 || rowOffsets[nodes] != slotCount)return false;
+	vector<char> seen(connectionCount, 0);
+	long long live = 0;
+	for (int p = 0; p < nodes; ++p) {
+		if (rowEnds[p] < rowOffsets[p] || rowOffsets[p + 1] < rowEnds[p] || rowOffsets[p + 1] > slotCount)return false;
+		for (int i = rowOffsets[p]; i < rowEnds[p]; ++i) {
+			if (sources[i] < 0 || sources[i] >= nodes || indices[i] < 0 || indices[i] >= connectionCount || seen[indices[i]])return false;
+			seen[indices[i]] = 1;
+		}
+		for (int i = rowEnds[p]; i < rowOffsets[p + 1]; ++i)
+			if (sources[i] != -1)return false;
+		live += rowEnds[p] - rowOffsets[p];
+	}
+	if (live != connectionCount)return false;
+
+	//Input and output nodes keep their ids, and every id has one position
+	seen.assign(nodes, 0);
+	for (int p = 0; p < nodes; ++p) {
+		if (order[p] < 0 || order[p] >= nodes || seen[order[p]] || (p < inputCount + outputCount && order[p] != p))return false;
+		seen[order[p]] = 1;
+	}
+	return true;
 }
 
-template <class T>
-EvolutionGNN<T>::EvolutionGNN(int inputCount, int outputCount, int threadCount) {
-	if (threadCount < 0)
-		this->threadCount = thread::hardware_concurrency() - 1;
-	else
-		this->threadCount = threadCount;
-	if (this->threadCount <= 0)
-		this->threadCount = 1;
+inline void ModelHeader::layout() {
+	long long end = sizeof(ModelHeader);
+	for (int s = 0; s < SECTION_COUNT; ++s) {
+		offsets[s] = (end + alignment - 1) / alignment * alignment;
+		end = offsets[s] + getSectionSize(s);
+	}
+	fileSize = end;
+}
 
-	for (int i = 0; i < inputCount; ++i)
-		this->inputNodes.push_back(InputGraphNode<T>(i));
-	for (int i = 0; i < outputCount; ++i)
-		this->outputNodes.push_back(OutputGraphNode<T>(i + inputCount));
+inline long long ModelHeader::getSectionSize(int section) {
+	long long nodes = getNodeSize();
+	switch (section) {
+	case SECTION_ROW_OFFSETS:
+		return (nodes + 1) * sizeof(int);
+	case SECTION_ROW_ENDS:
+	case SECTION_ORDER:
+		return nodes * sizeof(int);
+	case SECTION_SOURCES:
+	case SECTION_INDICES:
+		return slotCount * sizeof(int);
+	case SECTION_WEIGHTS:
+	case SECTION_READ:
+	case SECTION_WRITE:
+		return slotCount * valueSize;
+	case SECTION_STATES:
+		return slotCount;
+	case SECTION_VALUES:
+		return nodes * (version >= 3 ? accumulatorSize : valueSize);
+	case SECTION_ACTIVATIONS:
+		return nodes;
+	}
+	return 0;
+}
 
-	nodeCount = inputCount + outputCount;
+inline long long ModelHeader::getNodeSize() {
+	return inputCount + outputCount + hiddenCount;
 }
 
-template <class T>
-EvolutionGNN<T>::EvolutionGNN(int threadCount) {
-	if (threadCount < 0)
-		this->threadCount = thread::hardware_concurrency() - 1;
-	else
-		this->threadCount = threadCount;
-	if (this->threadCount <= 0)
-		this->threadCount = 1;
-	nodeCount = 0;
+template <class T, class Acc>
+void ModelHeader::initialize(unsigned int version) {
+	memset(this, 0, sizeof(ModelHeader));
+	memcpy(magic, MODEL_MAGIC, sizeof(MODEL_MAGIC));
+	this->version = version;
+	byteOrder = MODEL_BYTE_ORDER;
+	valueSize = sizeof(T);
+	alignment = MODEL_ALIGNMENT;
+
+	//Version 2 leaves these zero, like the padding it had there
+	if (version >= 3) {
+		accumulatorSize = sizeof(Acc);
+		valueType = getNumberType<T>();
+		accumulatorType = getNumberType<Acc>();
+	}
 }
 
 template <class T>
-void OutputGraphNode<T>::run() {
-	T sum = T(0);
-	for (shared_ptr<Connection<T>> ptr : this->inCon)
-		sum += ptr->get();
+template <class Activation, class Acc>
+void OutputGraphNode<T>::run(ConnectionPool<T>& pool, int activation) {
+	Acc sum = Acc(0);
+	for (ConnectionHandle in : this->inCon)
+		sum += pool[in].template get<Acc>();
 
 	//Activation function
-	sum = tanh(sum);
+	sum = applyActivation<Activation>(activation, sum);
 
-	output = sum;
+	output = T(sum);
 }
 
 template <class T>
@@ -1062,9 +6526,14 @@ T OutputGraphNode<T>::get() {
 }
 
 template <class T>
-void InputGraphNode<T>::run() {
-	for (shared_ptr<Connection<T>> ptr : this->outCon)
-		*ptr = input;
+void OutputGraphNode<T>::set(T val) {
+	output = val;
+}
+
+template <class T>
+void InputGraphNode<T>::run(ConnectionPool<T>& pool) {
+	for (ConnectionHandle out : this->outCon)
+		pool[out] = input;
 }
 
 template <class T>
@@ -1073,6 +6542,11 @@ T InputGraphNode<T>::operator=(T val) {
 	return input;
 }
 
+template <class T>
+T InputGraphNode<T>::get() {
+	return input;
+}
+
 //template <class T>
 //InputGraphNode<T>::InputGraphNode(int id) {
 //	input = T(0);
@@ -1080,22 +6554,22 @@ T InputGraphNode<T>::operator=(T val) {
 
 
 template <class T>
-vector<shared_ptr<Connection<T>>>& GraphNode<T>::getOutCon() {
+vector<ConnectionHandle>& GraphNode<T>::getOutCon() {
 	return outCon;
 }
 
 template <class T>
-vector<shared_ptr<Connection<T>>>& GraphNode<T>::getInCon() {
+vector<ConnectionHandle>& GraphNode<T>::getInCon() {
 	return inCon;
 }
 
 template <class T>
-void GraphNode<T>::removeDisconnectedConnections() {
+void GraphNode<T>::removeDisconnectedConnections(ConnectionPool<T>& pool) {
 	vector<int> indexs;
 
 	//Check for disconnected inCon
 	for (int i = 0; i < inCon.size(); ++i)
-		if (inCon[i]->disconnected())indexs.push_back(i);
+		if (pool[inCon[i]].disconnected())indexs.push_back(i);
 	//Remove disconnected inCon
 	for (int i = indexs.size(); i > 0; --i) {
 		inCon.erase(inCon.begin() + indexs.back());
@@ -1104,61 +6578,74 @@ void GraphNode<T>::removeDisconnectedConnections() {
 
 	//Check for disconnected outCon
 	for (int i = 0; i < outCon.size(); ++i)
-		if (outCon[i]->disconnected())indexs.push_back(i);
+		if (pool[outCon[i]].disconnected())indexs.push_back(i);
 	//Remove disconnected outCon
 	for (int i = indexs.size(); i > 0; --i) {
 		outCon.erase(outCon.begin() + indexs.back());
 		indexs.pop_back();
 	}
+
+	//Positions have changed
+	for (int i = 0; i < inCon.size(); ++i)
+		pool[inCon[i]].setInConIndex(i);
+	for (int i = 0; i < outCon.size(); ++i)
+		pool[outCon[i]].setOutConIndex(i);
 }
 
 template <class T>
-void GraphNode<T>::run() {
-	T sum = T(0);
-	for (shared_ptr<Connection<T>> ptr : this->inCon)
-		sum += ptr->get();
+template <class Activation, class Acc>
+void GraphNode<T>::run(ConnectionPool<T>& pool, int activation) {
+	Acc sum = Acc(0);
+	for (ConnectionHandle in : this->inCon)
+		sum += pool[in].template get<Acc>();
 
 	//Activation functions
-	sum = tanh(sum);
-	//if (sum < T(0))sum = T(0);
-	//sum = log(sum + 1.0);
+	sum = applyActivation<Activation>(activation, sum);
 
-	for (shared_ptr<Connection<T>> ptr : this->outCon)
-		*ptr = sum;
+	for (ConnectionHandle out : this->outCon)
+		pool[out] = T(sum);
 }
 
 template <class T>
-void GraphNode<T>::flipBuffer() {
+void GraphNode<T>::flipBuffer(ConnectionPool<T>& pool) {
 	//Flip all out-going buffer
-	for (shared_ptr<Connection<T>> ptr : this->outCon)
-		ptr->flipBuffer();
+	for (ConnectionHandle out : this->outCon)
+		pool[out].flipBuffer();
 }
 
 template <class T>
-void GraphNode<T>::removeOutCon(shared_ptr<Connection<T>> out) {
-	int index = 0;
-	for (; index < this->outCon.size(); ++index)
-		if (this->outCon[index] == out)break;
-	if (index < this->outCon.size())
-		this->outCon.erase(this->outCon.begin() + index);
+void GraphNode<T>::removeOutCon(ConnectionPool<T>& pool, ConnectionHandle out) {
+	int index = pool[out].getOutConIndex();
+	if (index < 0 || index >= this->outCon.size() || this->outCon[index] != out)return;
+
+	//Swap and pop
+	this->outCon[index] = this->outCon.back();
+	pool[this->outCon[index]].setOutConIndex(index);
+	this->outCon.pop_back();
+	pool[out].setOutConIndex(-1);
 }
 
 template <class T>
-void GraphNode<T>::addOutCon(shared_ptr<Connection<T>> out) {
+void GraphNode<T>::addOutCon(ConnectionPool<T>& pool, ConnectionHandle out) {
+	pool[out].setOutConIndex(this->outCon.size());
 	this->outCon.push_back(out);
 }
 
 template <class T>
-void GraphNode<T>::removeInCon(shared_ptr<Connection<T>> in) {
-	int index = 0;
-	for (; index < this->inCon.size(); ++index)
-		if (this->inCon[index] == in)break;
-	if (index < this->inCon.size())
-		this->inCon.erase(this->inCon.begin() + index);
+void GraphNode<T>::removeInCon(ConnectionPool<T>& pool, ConnectionHandle in) {
+	int index = pool[in].getInConIndex();
+	if (index < 0 || index >= this->inCon.size() || this->inCon[index] != in)return;
+
+	//Swap and pop
+	this->inCon[index] = this->inCon.back();
+	pool[this->inCon[index]].setInConIndex(index);
+	this->inCon.pop_back();
+	pool[in].setInConIndex(-1);
 }
 
 template <class T>
-void GraphNode<T>::addInCon(shared_ptr<Connection<T>> in) {
+void GraphNode<T>::addInCon(ConnectionPool<T>& pool, ConnectionHandle in) {
+	pool[in].setInConIndex(this->inCon.size());
 	this->inCon.push_back(in);
 }
 
@@ -1177,6 +6664,54 @@ GraphNode<T>::GraphNode(int id) {
 	this->id = id;
 }
 
+template <class T>
+void ConnectionPool<T>::clear() {
+	slots.clear();
+	freeList.clear();
+}
+
+template <class T>
+int ConnectionPool<T>::size() {
+	return slots.size() - freeList.size();
+}
+
+template <class T>
+ConnectionHandle ConnectionPool<T>::allocate(int count) {
+	ConnectionHandle first = slots.size();
+	slots.resize(slots.size() + count);
+	return first;
+}
+
+template <class T>
+void ConnectionPool<T>::reserve(int count) {
+	slots.reserve(count);
+}
+
+template <class T>
+Connection<T>& ConnectionPool<T>::operator[](ConnectionHandle handle) {
+	return slots[handle];
+}
+
+template <class T>
+void ConnectionPool<T>::release(ConnectionHandle handle) {
+	slots[handle] = Connection<T>();
+	freeList.push_back(handle);
+}
+
+template <class T>
+ConnectionHandle ConnectionPool<T>::create(int inNodeId, int outNodeId, T weight, T ABuffer, T BBuffer, bool useABuffer) {
+	//Reuse a released slot first
+	if (!freeList.empty()) {
+		ConnectionHandle handle = freeList.back();
+		freeList.pop_back();
+		slots[handle] = Connection<T>(inNodeId, outNodeId, weight, ABuffer, BBuffer, useABuffer);
+		return handle;
+	}
+
+	slots.push_back(Connection<T>(inNodeId, outNodeId, weight, ABuffer, BBuffer, useABuffer));
+	return slots.size() - 1;
+}
+
 template <class T>
 string Connection<T>::getDOT() {
 	string dot = to_string(inNodeId) + " -> " + to_string(outNodeId) + "[label=" + to_string(weight) + ", weight=" + to_string(weight) + ", color=" + (weight > 0.0 ? "red" : "blue") + "];";
@@ -1204,6 +6739,36 @@ void Connection<T>::writeToFile(fstream& out) {
 	out.write(reinterpret_cast<char*>(&useABuffer), sizeof(bool));
 }
 
+template <class T>
+void Connection<T>::setOutConIndex(int index) {
+	outConIndex = index;
+}
+
+template <class T>
+int Connection<T>::getOutConIndex() {
+	return outConIndex;
+}
+
+template <class T>
+void Connection<T>::setInConIndex(int index) {
+	inConIndex = index;
+}
+
+template <class T>
+int Connection<T>::getInConIndex() {
+	return inConIndex;
+}
+
+template <class T>
+void Connection<T>::setIndex(int index) {
+	this->index = index;
+}
+
+template <class T>
+int Connection<T>::getIndex() {
+	return index;
+}
+
 template <class T>
 bool Connection<T>::disconnected() {
 	return (inNodeId == -1 || outNodeId == -1);
@@ -1249,6 +6814,16 @@ T Connection<T>::getWeight() {
 	return this->weight;
 }
 
+template <class T>
+void Connection<T>::setBBuffer(T val) {
+	BBuffer = val;
+}
+
+template <class T>
+void Connection<T>::setABuffer(T val) {
+	ABuffer = val;
+}
+
 template <class T>
 T Connection<T>::getBBuffer() {
 	return BBuffer;
@@ -1260,11 +6835,12 @@ T Connection<T>::getABuffer() {
 }
 
 template <class T>
-T Connection<T>::get() {
+template <class Acc>
+Acc Connection<T>::get() {
 	if (useABuffer)
-		return weight * BBuffer;
+		return Acc(weight) * Acc(BBuffer);
 	else
-		return weight * ABuffer;
+		return Acc(weight) * Acc(ABuffer);
 }
 
 template <class T>
@@ -1298,6 +6874,7 @@ Connection<T>::Connection(int inNodeId, int outNodeId, T weight, T ABuffer, T BB
 	this->BBuffer = BBuffer;
 	this->inNodeId = inNodeId;
 	this->outNodeId = outNodeId;
+	index = inConIndex = outConIndex = -1;
 }
 
 template <class T>
@@ -1308,6 +6885,7 @@ Connection<T>::Connection() {
 	BBuffer = T(0);
 	inNodeId = -1;
 	outNodeId = -1;
+	index = inConIndex = outConIndex = -1;
 }
 
 
@@ -0,0 +1,241 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <sstream>
+#include <chrono>
+#include <cstdio>
+#include "T_EvolutionGraphNN.h"
+
+using namespace std;
+
+//Usage: ./benchmark [--format csv|json] [--max-edges N] [--threads 1,2,4] [--min-time seconds]
+//Built with T_EVOLUTIONGRAPHNN_PERF_COUNTERS, see make bench-perf, run() also prints where its time went
+//Every row reports one operation at one size, so rows of two releases can be compared directly
+//edges_per_second counts connections visited, it is 0 for mutate() which only touches a few
+
+//One measured operation
+struct Result {
+	string benchmark;	//Name of the operation
+	string mode;		//Variant of the operation
+	long long edges;	//Number of connections of the network
+	int threads;		//Number of threads used
+	long long iterations;
+	double seconds;
+	double opsPerSecond;
+	double edgesPerSecond;
+};
+
+//Settings from the command line
+struct Options {
+	string format = "csv";
+	long long maxEdges = 10000000;
+	vector<int> threads;
+	double minTime = 0.5;
+};
+
+vector<Result> results;
+Options options;
+
+//Call work(iterations) with growing iterations until it takes at least minTime
+//Return seconds of the last call, iterations is set to its count
+template <class Work>
+double measure(long long& iterations, const Work& work) {
+	iterations = 1;
+	while (true) {
+		auto start = chrono::steady_clock::now();
+		work(iterations);
+		double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		if (seconds >= options.minTime || iterations >= (1LL << 40))return seconds;
+
+		//Aim a bit past minTime, at most 10 times more iterations at once
+		double scale = seconds > 0 ? options.minTime * 1.2 / seconds : 10.0;
+		iterations = (long long)(iterations * min(10.0, max(2.0, scale)));
+	}
+}
+
+void report(string benchmark, string mode, long long edges, int threads, long long iterations, double seconds, long long edgesPerIteration) {
+	Result r = { benchmark, mode, edges, threads, iterations, seconds, iterations / seconds, (double)iterations * edgesPerIteration / seconds };
+	results.push_back(r);
+	cerr << left << setw(10) << benchmark << setw(10) << mode << right << setw(10) << edges << setw(4) << threads
+		<< setw(14) << fixed << setprecision(1) << r.opsPerSecond << " ops/s" << setw(16) << r.edgesPerSecond << " edges/s" << endl;
+}
+
+//Network with edges random connections between edges / 10 hidden nodes
+void build(EvolutionGNN<float>& egnn, long long edges, int threads) {
+	egnn.initialize(16, 16, threads);
+	egnn.seed(42);
+	egnn.addNodes(max(1LL, edges / 10));
+	egnn.addRandomConnection(edges);
+}
+
+//Steps per second of run() and flipBuffer(), on GraphNodes, on the compiled graph
+//and on 8 and 16 bit quantized copies, which always run on a single thread
+void benchRun() {
+	const char* modes[] = { "graph", "compiled", "q8", "q16" };
+	for (long long edges = 1000; edges <= options.maxEdges; edges *= 10)
+		for (int threads : options.threads) {
+			EvolutionGNN<float> egnn;
+			build(egnn, edges, threads);
+			for (int i = 0; i < 16; ++i)
+				egnn.setInput(i, 0.5f);
+
+			for (int mode = 0; mode < 4; ++mode) {
+				if (mode >= 2 && threads != 1)continue;
+				if (mode == 1)egnn.compile();
+				if (mode >= 2)egnn.quantize(mode == 2 ? 8 : 16);
+				long long iterations;
+				egnn.getPerfCounters().reset();
+				double seconds = measure(iterations, [&](long long steps) {
+					for (long long s = 0; s < steps; ++s) {
+						egnn.run();
+						egnn.flipBuffer();
+					}
+				});
+				report("run", modes[mode], edges, threads, iterations, seconds, edges);
+#ifdef T_EVOLUTIONGRAPHNN_PERF_COUNTERS
+				cerr << egnn.getPerfCounters().summary() << endl;
+#endif
+			}
+		}
+}
+
+//mutate() with balanced rates, so the size of the network stays about the same
+void benchMutate() {
+	for (long long edges = 1000; edges <= min(options.maxEdges, 100000LL); edges *= 10) {
+		EvolutionGNN<float> egnn;
+		build(egnn, edges, 1);
+		long long iterations;
+		double seconds = measure(iterations, [&](long long count) {
+			for (long long i = 0; i < count; ++i)
+				egnn.mutate(0.5, 0.5, 0.0001, 0.5, 0.01);
+		});
+		report("mutate", "default", edges, 1, iterations, seconds, 0);
+	}
+}
+
+//inherit() from two parents of the same size
+void benchInherit() {
+	for (long long edges = 1000; edges <= min(options.maxEdges, 1000000LL); edges *= 10) {
+		EvolutionGNN<float> parentA, parentB, child(1);
+		build(parentA, edges, 1);
+		build(parentB, edges, 1);
+		parentB.seed(7);
+		parentB.mutate(0.5, 0.5, 0.0001, 0.9);
+		long long iterations;
+		double seconds = measure(iterations, [&](long long count) {
+			for (long long i = 0; i < count; ++i)
+				child.inherit(parentA, parentB);
+		});
+		report("inherit", "default", edges, 1, iterations, seconds, 2 * edges);
+	}
+}
+
+//save() and load() of both file versions
+void benchFile() {
+	string filename = "./bench.TEvoGNN";
+	for (long long edges = 1000; edges <= min(options.maxEdges, 1000000LL); edges *= 10)
+		for (int version = 1; version <= MODEL_VERSION; ++version) {
+			EvolutionGNN<float> egnn, loaded(1);
+			build(egnn, edges, 1);
+			string mode = "v" + to_string(version);
+			long long iterations;
+
+			double seconds = measure(iterations, [&](long long count) {
+				for (long long i = 0; i < count; ++i)
+					egnn.save(filename, version);
+			});
+			report("save", mode, edges, 1, iterations, seconds, edges);
+
+			seconds = measure(iterations, [&](long long count) {
+				for (long long i = 0; i < count; ++i)
+					loaded.load(filename);
+			});
+			report("load", mode, edges, 1, iterations, seconds, edges);
+		}
+	remove(filename.c_str());
+}
+
+//getDOT() of small networks, larger ones are not drawn anyway
+void benchDOT() {
+	for (long long edges = 1000; edges <= min(options.maxEdges, 100000LL); edges *= 10) {
+		EvolutionGNN<float> egnn;
+		build(egnn, edges, 1);
+		long long iterations;
+		size_t length = 0;
+		double seconds = measure(iterations, [&](long long count) {
+			for (long long i = 0; i < count; ++i)
+				length += egnn.getDOT().size();
+		});
+		report("getDOT", "default", edges, 1, iterations, seconds, edges);
+	}
+}
+
+void printCSV() {
+	cout << "benchmark,mode,edges,threads,iterations,seconds,ops_per_second,edges_per_second" << endl;
+	cout << setprecision(9) << defaultfloat;
+	for (Result& r : results)
+		cout << r.benchmark << ',' << r.mode << ',' << r.edges << ',' << r.threads << ',' << r.iterations << ','
+			<< r.seconds << ',' << r.opsPerSecond << ',' << r.edgesPerSecond << endl;
+}
+
+void printJSON() {
+	cout << setprecision(9) << defaultfloat;
+	cout << "{" << endl;
+	cout << "\t\"hardware_threads\": " << thread::hardware_concurrency() << "," << endl;
+	cout << "\t\"results\": [" << endl;
+	for (int i = 0; i < results.size(); ++i) {
+		Result& r = results[i];
+		cout << "\t\t{\"benchmark\": \"" << r.benchmark << "\", \"mode\": \"" << r.mode << "\", \"edges\": " << r.edges
+			<< ", \"threads\": " << r.threads << ", \"iterations\": " << r.iterations << ", \"seconds\": " << r.seconds
+			<< ", \"ops_per_second\": " << r.opsPerSecond << ", \"edges_per_second\": " << r.edgesPerSecond << "}"
+			<< (i + 1 < results.size() ? "," : "") << endl;
+	}
+	cout << "\t]" << endl;
+	cout << "}" << endl;
+}
+
+int main(int argc, char* argv[]) {
+
+	//Read options
+	for (int i = 1; i + 1 < argc; i += 2) {
+		string name = argv[i], value = argv[i + 1];
+		if (name == "--format")options.format = value;
+		else if (name == "--max-edges")options.maxEdges = stoll(value);
+		else if (name == "--min-time")options.minTime = stod(value);
+		else if (name == "--threads") {
+			stringstream list(value);
+			string item;
+			while (getline(list, item, ','))
+				options.threads.push_back(stoi(item));
+		}
+		else {
+			cerr << "Unknown option " << name << endl;
+			return 1;
+		}
+	}
+	if (options.format != "csv" && options.format != "json") {
+		cerr << "Format should be csv or json" << endl;
+		return 1;
+	}
+
+	//Thread counts default to powers of two up to the number of cores
+	if (options.threads.empty()) {
+		int cores = max(1u, thread::hardware_concurrency());
+		for (int t = 1; t < cores; t *= 2)
+			options.threads.push_back(t);
+		options.threads.push_back(cores);
+	}
+
+	//Progress goes to cerr, so cout only holds the results
+	benchRun();
+	benchMutate();
+	benchInherit();
+	benchFile();
+	benchDOT();
+
+	if (options.format == "json")printJSON();
+	else
+		printCSV();
+
+	return 0;
+}
@@ -5,14 +5,14 @@
 
 using namespace std;
 
-template <class T>
-void test(EvolutionGNN<T>& gnn, string printout, int iterations = 10) {
+template <class T, class Activation, class Acc>
+void test(EvolutionGNN<T, Activation, Acc>& gnn, string printout, int iterations = 10) {
 	cout << endl << printout << endl;
 	
 	for(int i = 0; i < iterations; ++i){
 		gnn.run();
 		gnn.flipBuffer();
-		cout << setw(7) << gnn.getOutput(0);
+		cout << setw(7) << (float)gnn.getOutput(0);
 	}
 	cout << endl;
 }
@@ -160,6 +160,208 @@ int main(){
 	
 	
 	
+	//Testing compiled execution
+	loaded.compile();
+	//Set input
+	loaded.setInput(0, 1);
+	loaded.setInput(1, -1);
+	//Test
+	test(loaded, "Compiled AND GATE with input [1,  -1], expected output [-1]");
+	
+	//Set input
+	loaded.setInput(0, 1);
+	loaded.setInput(1, 1);
+	//Test
+	test(loaded, "Compiled AND GATE with input [1,   1], expected output [ 1]");
+	
+	cout << endl;
+	
+	
+	
+	//Testing execution of a saved file in place, next to a loaded copy of it
+	CompiledGraph<float> mapped;
+	EvolutionGNN<float> reloaded;
+	if (mapped.map("AND_GATE.TEvoGNN") && reloaded.load("AND_GATE.TEvoGNN")) {
+		//Set input
+		mapped.setValue(0, 1);
+		mapped.setValue(1, -1);
+		reloaded.setInput(0, 1);
+		reloaded.setInput(1, -1);
+		cout << endl << "Mapped and loaded AND GATE with input [1,  -1], expected output [-1] on both rows" << endl;
+		vector<float> mappedOutputs, loadedOutputs;
+		for (int i = 0; i < 10; ++i) {
+			//A step of the mapped graph, like run() and flipBuffer() on a compiled network
+			mapped.runNodes(0, mapped.getNodeSize(), mapped.getParity());
+			mapped.writeConnections(0, mapped.getSlotSize(), mapped.getParity());
+			mapped.flipBuffer();
+			mappedOutputs.push_back(mapped.getValue(2));
+			reloaded.run();
+			reloaded.flipBuffer();
+			loadedOutputs.push_back(reloaded.getOutput(0));
+		}
+		for (float output : mappedOutputs)
+			cout << setw(7) << output;
+		cout << endl;
+		for (float output : loadedOutputs)
+			cout << setw(7) << output;
+		cout << endl << endl;
+	}
+	else
+		cout << "Mapping AND_GATE.TEvoGNN failed" << endl << endl;
+	
+	
+	
+	//Testing to load a large network on several threads, which decode connections in blocks
+	EvolutionGNN<float> large(16, 16, 1);
+	large.seed(42);
+	large.addNodes(40000);
+	large.addRandomConnection(400000);
+	for (int i = 0; i < 16; ++i)
+		large.setInput(i, 0.5f);
+	large.runSteps(5);
+	for (int version : { 1, (int)MODEL_VERSION }) {
+		large.save("LARGE.TEvoGNN", version);
+		EvolutionGNN<float> serial(1), parallel(4);
+		serial.load("LARGE.TEvoGNN");
+		parallel.load("LARGE.TEvoGNN");
+		serial.runSteps(10);
+		parallel.runSteps(10);
+		float difference = 0;
+		for (int i = 0; i < 16; ++i)
+			difference = max(difference, abs(serial.getOutput(i) - parallel.getOutput(i)));
+		cout << "Version " << version << " network of 400000 connections loaded on 1 and 4 threads, largest difference of outputs after 10 steps: " << difference << endl;
+	}
+	cout << endl;
+	
+	
+	
+	//Testing batched execution, all cases of AND GATE run side by side
+	EvolutionGNN<float> batched;
+	batched.load("AND_GATE.TEvoGNN");
+	batched.setBatchSize(4);
+	//Set inputs
+	batched.setInputs({ { -1, -1 }, { 1, -1 }, { -1, 1 }, { 1, 1 } });
+	//Run 10 steps
+	batched.runSteps(10);
+	//Show outputs
+	vector<vector<float>> outputs;
+	batched.getOutputs(outputs);
+	cout << endl << "Batched AND GATE with inputs [-1, -1], [1, -1], [-1, 1], [1, 1], expected outputs [-1, -1, -1, 1]" << endl;
+	for (int i = 0; i < outputs.size(); ++i)
+		cout << setw(7) << outputs[i][0];
+	cout << endl << endl;
+	
+	
+	
+	//Testing event driven execution, settled nodes are not run again
+	EvolutionGNN<float> events;
+	events.load("AND_GATE.TEvoGNN");
+	events.setEventDriven(true);
+	//Set input
+	events.setInput(0, 1);
+	events.setInput(1, 1);
+	//Test
+	test(events, "Event driven AND GATE with input [1,   1], expected output [ 1]");
+	cout << "Nodes run by the last step: " << events.getActiveSize() << endl << endl;
+	
+	
+	//Run an oscillator until its output repeats
+	EvolutionGNN<float> oscillator;
+	oscillator.initialize(1, 1);
+	oscillator.addNodes();
+	oscillator.addConnection(0, 2, 20.0);
+	oscillator.addConnection(2, 2, -40.0);
+	oscillator.addConnection(2, 1, 20.0);
+	//Kick start for one step
+	oscillator.setInput(0, 1);
+	oscillator.run();
+	oscillator.flipBuffer();
+	oscillator.setInput(0, 0);
+	int steps;
+	int period = oscillator.runUntilStable(100, 0.0f, &steps);
+	cout << "Oscillator repeats with period " << period << " after " << steps << " steps, expected period 2" << endl << endl;
+	
+	
+	//Skip nodes that can not affect the output
+	EvolutionGNN<float> pruned(2, 1);
+	pruned.addNodes(5);
+	pruned.addConnection(0, 3, 20);
+	pruned.addConnection(3, 2, 20);
+	//Node 4 only feeds node 5, which has no path to the output
+	pruned.addConnection(1, 4, 20);
+	pruned.addConnection(4, 5, 20);
+	//Node 6 has no input, and settles after one step
+	pruned.addConnection(7, 6, 20);
+	pruned.addConnection(6, 2, 20);
+	pruned.setPruning(true);
+	pruned.setInput(0, 1);
+	pruned.setInput(1, 1);
+	test(pruned, "Pruned network with input [1,   1], expected output [ 1]");
+	cout << "Nodes visited per step: " << pruned.getLiveSize() << " of 8" << endl << endl;
+	
+	
+	//Settle the hidden layer of the OR gate within a single step
+	EvolutionGNN<float> settled = orGate;
+	settled.setSettling(true);
+	settled.setInput(0, -1);
+	settled.setInput(1, -1);
+	test(settled, "Settled OR GATE with input [-1, -1], expected output [-1] from the first step", 3);
+	settled.setInput(0, 1);
+	test(settled, "Settled OR GATE with input [1,  -1], expected output [ 1] from the first step", 3);
+	cout << endl;
+	
+	
+	//Run the OR gate with 8 bit weights and values
+	EvolutionGNN<float> quantized = orGate;
+	quantized.quantize(8);
+	quantized.setInput(0, -1);
+	quantized.setInput(1, -1);
+	test(quantized, "8 bit OR GATE with input [-1, -1], expected output [-1]");
+	quantized.setInput(1, 1);
+	test(quantized, "8 bit OR GATE with input [-1,  1], expected output [ 1]");
+	
+	//States of the 8 bit copy are written back, rounded, before saving
+	quantized.save("OR_GATE_8BIT.TEvoGNN");
+	EvolutionGNN<float> dequantized;
+	dequantized.load("OR_GATE_8BIT.TEvoGNN");
+	test(dequantized, "Loaded 8 bit OR GATE with input [-1,  1], expected output [ 1] from the first step", 3);
+	cout << endl;
+	
+	
+#ifdef __FLT16_MAX__
+	//AND gate with 16 bit weights and buffers, summed up in float
+	EvolutionGNN<_Float16, TanhActivation, float> halfGate(2, 1);
+	halfGate.addNodes(3);
+	halfGate.addConnection(0, 2, 40);
+	halfGate.addConnection(1, 2, 40);
+	halfGate.addConnection(3, 3, 20, 1, 1);
+	halfGate.addConnection(3, 2, -60);
+	halfGate.setInput(0, 1);
+	halfGate.setInput(1, -1);
+	test(halfGate, "Half precision AND GATE with input [1,  -1], expected output [-1]");
+	halfGate.setInput(1, 1);
+	test(halfGate, "Half precision AND GATE with input [1,   1], expected output [ 1]");
+	cout << endl;
+#endif
+	
+	
+	
+	//Removed nodes keep their ids for addNodes(), unless they are connected again
+	EvolutionGNN<float> reuse(1, 1);
+	reuse.addNodes(2);
+	reuse.removeNode(3);
+	cout << "Hidden nodes after removing node 3: " << reuse.getHiddenSize() << ", expected 1" << endl;
+	reuse.addConnection(0, 3, 20);
+	reuse.addConnection(3, 1, 20);
+	cout << "Hidden nodes after connecting node 3 again: " << reuse.getHiddenSize() << ", expected 2" << endl;
+	vector<int> added = reuse.addNodes(1);
+	cout << "Added node " << added[0] << ", expected 4, hidden nodes: " << reuse.getHiddenSize() << ", expected 3" << endl;
+	reuse.removeNode(2);
+	added = reuse.addNodes(2);
+	cout << "Added nodes " << added[0] << " and " << added[1] << ", expected 2 and 5, hidden nodes: " << reuse.getHiddenSize() << ", expected 4" << endl << endl;
+	
+	
+	
 	//Following section demostrate mutation, inheritance and saving as DOT
 	
 	//Generate a random network
@@ -194,5 +396,45 @@ int main(){
 	//Save DOT
 	c.saveDOT("cNetwork.dot");
 	
+	
+	
+	//Following section demostrate evolving a population towards an AND gate
+	
+	//50 genomes with 2 inputs and 1 output
+	Population<float> population(50, 2, 1);
+	//Create more connections and nodes than default
+	population.setMutation(0.9, 0.1, 0.05);
+	//Fitness is the negative squared error over the truth table
+	auto andFitness = [](EvolutionGNN<float>& egnn) {
+		double fitness = 0.0;
+		float table[4][3] = { {-1, -1, -1}, {1, -1, -1}, {-1, 1, -1}, {1, 1, 1} };
+		for (int i = 0; i < 4; ++i) {
+			egnn.setInput(0, table[i][0]);
+			egnn.setInput(1, table[i][1]);
+			egnn.runSteps(10);
+			fitness -= (egnn.getOutput(0) - table[i][2]) * (egnn.getOutput(0) - table[i][2]);
+		}
+		return fitness;
+	};
+	//Evolve for 30 generations, with a checkpoint written in the background halfway
+	population.evolve(andFitness, 15);
+	population.checkpoint("AND_GATE.checkpoint.TEvoPOP");
+	population.evolve(andFitness, 15);
+	population.waitCheckpoint();
+	population.evaluate(andFitness);
+	cout << "Population after " << population.getGeneration() << " generations" << endl;
+	double best = population.getFitness(0);
+	for (int i = 1; i < population.getSize(); ++i)
+		if (population.getFitness(i) > best)best = population.getFitness(i);
+	cout << "Best fitness: " << best << endl;
+	cout << population.getBest() << endl;
+	
+	//Save the whole population into one archive and load it back
+	population.save("AND_GATE.TEvoPOP");
+	Population<float> restored;
+	restored.load("AND_GATE.TEvoPOP");
+	cout << "Restored " << restored.getSize() << " genomes of generation " << restored.getGeneration() << endl;
+	cout << restored.getBest() << endl;
+	
 	return 0;
 }